@@ -18,17 +18,30 @@
 */
 
 #include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <regex.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
 #include <termios.h>
 #include <unistd.h>
 
 #ifdef __linux__
 #include <linux/limits.h>
+#include <sys/inotify.h>
 #elif __FreeBSD__
 #include <sys/syslimits.h>
 #elif __OpenBSD__
@@ -42,12 +55,41 @@
 #include <str.h>
 #include <util.h>
 
-#define CURBUF (be.buffers.data[be.windows.data[be.focusedwin].buffer])
-#define CURBUFINDEX (be.windows.data[be.focusedwin].buffer)
+#define CURBUF (be.buffers.data[BUFSLOT(be.windows.data[be.focusedwin].buffer)].b)
+#define CURBUFID (be.windows.data[be.focusedwin].buffer)
 #define CURWIN (be.windows.data[be.focusedwin])
 #define CURWININDEX (be.focusedwin)
+#define COUNT(IA) ((IA)->n ? (IA)->n : 1)
 #define REPLACE (void *)(-1)
 #define SUBMODES_MAX 32
+#define MARKBITS (sizeof (unsigned long) * CHAR_BIT)
+#define WRITEIOV 512
+#define REGISTERS 27 /* unnamed and a-z */
+#define MACROS 26 /* a-z */
+#define MACRODEPTH 16
+#define CHANGELOG 64 /* changes remembered per buffer */
+#define SYNSTALE 0xff /* line was not lexed since its last change */
+#define BUFID(SLOT, GEN) ((BufId)(GEN) << 32 | (BufId)(SLOT))
+#define BUFSLOT(ID) ((size_t)((ID) & 0xffffffff))
+#define BUFNONE ((BufId)-1)
+#define LOWBIT(I) ((I) & (~(I) + 1))
+#define WINROWSMIN 3 /* window rows with status line */
+#define WINCOLSMIN 10
+#define JOBREAD 65536 /* bytes of command output or followed file read at once */
+#define JOBBURST 16 /* reads of command output between screen updates */
+#define SORTRUN 32 /* keys sorted by insertion before merging */
+#define SORTMIN 65536 /* keys per sorting thread at least */
+#define JOURNALMAGIC "BEJ1"
+#define JOURNALS 8 /* journals of one file, for buffers editing it at once */
+#define JOURNALDIRECT 65536 /* bytes of text of record written without copying */
+#define INDEXMAGIC "BEX1"
+#define INDEXHEADER 64 /* bytes of index header at most */
+#define WORDMIN 2 /* length of words indexed for completion */
+#define WORDMAX 64
+#define WORDSYNC 4096 /* changed lines whose words are indexed in background */
+#define COMPLETEMAX 256 /* words offered for completion */
+#define TAGDEPTH 16 /* directories walked into for tags */
+#define FOLLOWFILE (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
 
 #ifdef UNLIMITED
 #define PATH_MAX 1024
@@ -61,9 +103,28 @@ typedef enum Mod {
 typedef enum Mode {
 	ModeNormal, ModeEdit, ModeReplace,
 	ModeBuffer, ModeCommand,
-	SubModeGlobal,
+	SubModeGlobal, SubModeOperator,
 } Mode;
 
+typedef enum Operator {
+	OpDelete, OpChange, OpYank,
+} Operator;
+
+typedef enum Motion {
+	MotionNone, MotionExclusive, MotionInclusive, MotionLinewise,
+} Motion;
+
+typedef enum Highlight {
+	HlNormal, HlComment, HlString, HlNumber, HlKeyword, HlType,
+	HlPreproc, HlError, HlWarning,
+} Highlight;
+
+/* lexer state at the end of a line; past SynString is
+   the index of the open quote in Syntax.quotes */
+typedef enum SynState {
+	SynNormal, SynComment, SynString,
+} SynState;
+
 typedef union Arg {
 	int i;
 	unsigned int ui;
@@ -72,13 +133,14 @@ typedef union Arg {
 	const void *v;
 } Arg;
 
-typedef union IArg {
-	int i;
-	unsigned int ui;
+typedef struct IArg {
 	char c;
-	float f;
-	const void *v;
-	String S;
+	String S;          /* command arguments */
+	ssize_t l1, l2;    /* command range, inclusive */
+	int addrs;         /* number of addresses given */
+	int marked;        /* range is the set of marked lines */
+	int bang;
+	size_t n;          /* count prefix, 0 if none was typed */
 } IArg;
 
 typedef struct Key {
@@ -95,25 +157,278 @@ typedef struct Command {
 	const Arg arg;
 } Command;
 
+typedef struct SynWord {
+	const char *word;
+	Highlight hl;
+} SynWord;
+
+typedef struct Syntax {
+	const char *name;
+	const char *match;       /* name suffixes, names and #! first lines */
+	const char *comment;     /* line comment */
+	const char *open, *close; /* block comment */
+	const char *quotes;
+	char directive;          /* line starting with it is a directive */
+	char variable;           /* it starts a variable name */
+	int multiline;           /* strings go on past end of line */
+	const SynWord *words;    /* terminated by NULL word */
+} Syntax;
+
+/* reference counted line storage, shared by lines of one file read,
+   yanked lines and registers; written only when not shared.  Lines of
+   file opened through its index point into mapping of the file, whose
+   address is kept in data */
+typedef struct Chunk {
+	size_t ref;
+	size_t map; /* bytes of file mapped, 0 if lines point into data */
+	char data[];
+} Chunk;
+
 typedef struct Line {
 	char *data;
 	size_t len;
-	int isMarked;
+	Chunk *chunk;
+	unsigned long gen; /* buffer drawgen of last change of how it looks */
+	unsigned char hlin, hl; /* lexer state before and after the line */
 } Line;
 
+typedef Array(Line) Lines;
+
+/* buffer handle: slot in buffer table and its generation,
+   so handle of closed buffer does not refer to slot's next one */
+typedef uint64_t BufId;
+
+/* line at was changed; if shift, lines from at on
+   were also inserted, removed or moved */
+typedef struct Change {
+	unsigned long epoch;
+	size_t at;
+	int shift;
+	size_t tail; /* lines at end of buffer it left as they were */
+} Change;
+
+/* file read in background by loader thread */
+typedef struct Load {
+	char *path;
+	BufId buf;
+	Lines lines;
+	struct stat sb;
+	int err; /* errno of failed read, 0 if none */
+} Load;
+
+/* command writing into buffer */
+typedef struct Job {
+	char *cmd;
+	pid_t pid;
+	int fd;
+	BufId buf;
+} Job;
+
+/* file followed by buffer: bytes appended to it are read into buffer,
+   inotify wakes editor when file or its directory changes */
+typedef struct Follow {
+	int fd, in, wd;
+	off_t off; /* bytes of file in buffer */
+	int nl;    /* they end with newline, so next byte starts a line */
+	BufId buf;
+} Follow;
+
+typedef enum SortFlag {
+	SortNumeric = 1, SortReverse = 2, SortUnique = 4,
+} SortFlag;
+
+/* sort key of line i of range, text from s on; pre holds what is
+   compared first, so most comparisons do not touch line text: 16 bytes
+   of text after prefix common to all keys, or the number in numeric
+   sort, made comparable as unsigned (0 if line has no number) */
+typedef struct SortKey {
+	const char *s;
+	size_t len;
+	uint64_t pre[2];
+	size_t i;
+} SortKey;
+
+/* sorts src[lo, hi) if mid is lo, otherwise merges its sorted
+   [lo, mid) and [mid, hi) into dst */
+typedef struct SortJob {
+	SortKey *src, *dst;
+	size_t lo, mid, hi;
+	int flags;
+} SortJob;
+
+/* changes of buffer not written to its file, kept in journal file */
+typedef struct Journal {
+	int fd;       /* locked while it is written, -1 if none could be */
+	char *path;
+	String rec;   /* records not written yet */
+	int unsynced; /* records written but not synced */
+} Journal;
+
+/* index of words of all buffers is a ternary search tree;
+   node 0 is none */
+typedef struct WordNode {
+	uint32_t next[3]; /* lower, following and higher characters */
+	int32_t count;    /* occurrences of word ending here */
+	char c;
+} WordNode;
+
+/* lines whose words are taken out of index and put into it;
+   many of them are counted in background */
+typedef struct WordJob {
+	Lines del, add;
+} WordJob;
+
+/* definition found in C source */
+typedef struct Tag {
+	char *name;
+	char *path;       /* file of tag found in directory, NULL in buffer */
+	size_t y, x;
+	size_t top;       /* line before it scanning may start again from */
+} Tag;
+
+typedef Array(Tag) Tags;
+
+/* name seen while scanning, pointing into line */
+typedef struct TagName {
+	const char *s;
+	size_t n, y, x;
+} TagName;
+
+/* scanning state carried from line to line */
+typedef struct TagScan {
+	int depth, paren;
+	int comment;   /* in block comment */
+	int directive; /* in directive continued with backslash */
+	int typedefs;  /* typedef seen on top level */
+	int sue;       /* struct, union or enum seen (1), with its name (2) */
+	int params;    /* parameter list of cand was closed */
+	int ident;     /* last token was identifier */
+	int star;      /* last token was '*' */
+	size_t top;    /* last line started on top level */
+	TagName last, cand, tdef, suename;
+} TagScan;
+
+/* lines of buffer from line from on scanned in background,
+   or files of directory dir */
+typedef struct TagJob {
+	BufId buf;
+	unsigned long epoch;
+	size_t len;     /* lines of buffer at epoch */
+	size_t from;
+	Lines lines;    /* given in batches, scanned up to scanned */
+	Array(size_t) stops; /* lines of batch old scan was on top level at */
+	size_t stop;    /* one of them scanning stopped at, SIZE_MAX if none */
+	size_t scanned, batch;
+	TagScan st;
+	char *dir;
+	Tags tags;
+	Array(char *) files;
+} TagJob;
+
+/* text occurring in old and new lines of reloaded file */
+typedef struct LineMatch {
+	const Line *l;
+	uint64_t hash;
+	size_t na, nb; /* times it occurs in them */
+	size_t a;      /* index of last old line with it */
+} LineMatch;
+
 typedef struct Buffer {
-	Array(Line) lines;
-	char path[PATH_MAX], name[NAME_MAX];
+	Lines lines;
+	Array(unsigned long) marks; /* bit per line, trailing zero words trimmed */
+	char *path;
+	const char *name; /* last component of path */
+	struct stat sb;   /* file when it was read or written last */
+	int wd;           /* inotify watch of its directory, -1 if none */
+	int stale;        /* file changed since, but buffer was kept */
 	int anonymous, dirty;
+	unsigned long epoch; /* bumped by every change of text */
+	unsigned long drawgen; /* bumped by every change of how lines look */
+	Change changes[CHANGELOG]; /* ring, changes[nchanges % CHANGELOG] is next */
+	size_t nchanges;
+	const Syntax *syntax;
+	size_t synvalid;        /* lines lexed in sequence from the top */
+	unsigned long synepoch; /* epoch synvalid is up to date with */
+	Array(size_t) bytes;    /* Fenwick tree of lengths of lines with newlines */
+	unsigned long bytesepoch; /* epoch bytes is up to date with */
+	Lines words;            /* lines as their words were indexed */
+	unsigned long wordsepoch; /* epoch words is up to date with */
+	Tags tags;              /* definitions, by line */
+	unsigned long tagepoch; /* epoch tags are up to date with */
+	size_t taglen;          /* lines at tagepoch */
+	int tagged;             /* tags were scanned at least once */
+	TagJob *tagjob;         /* tags being scanned, NULL if none */
+	Load *load;             /* being read in background, NULL if not */
+	Job *job;               /* command writing into it, NULL if none */
+	Follow *follow;         /* file followed, NULL if none */
+	Journal *jnl;           /* journal of changes, NULL until first one */
+	int idxstale;           /* line from index did not end with newline */
 	ssize_t x, y, xvis, xoff;
 	Mode mode;
 	Mode submodes[SUBMODES_MAX];
 	size_t submodeslen;
 } Buffer;
 
+typedef struct Slot {
+	Buffer b;
+	unsigned int gen;
+	int live;
+	/* open buffers are a ring through fallback buffer in slot 0,
+	   free slots a list through next */
+	size_t prev, next;
+} Slot;
+
+typedef struct Register {
+	Array(Line) lines;
+	int linewise;
+	BufId buf; /* buffer lines were yanked from in one piece, */
+	size_t y;  /* and line they started at; BUFNONE if they were not */
+} Register;
+
+typedef enum Split {
+	SplitNone, SplitRows, SplitColumns,
+} Split;
+
+/* cursor of window while it is not focused, the focused one
+   has it in its buffer */
+typedef struct View {
+	ssize_t x, y, xvis, xoff;
+} View;
+
+/* node of layout: window or area split between two children */
+typedef struct Layout {
+	Split split;
+	size_t win;        /* index of window if not split */
+	int y, x, r, c;
+	struct Layout *parent, *child[2];
+} Layout;
+
+/* what status line shows besides cursor position, the parts of it
+   kept in window are made again only when this changes */
+typedef struct StatusKey {
+	BufId buf;
+	const char *name;
+	unsigned long epoch, drawgen;
+	Mode mode, submodes[SUBMODES_MAX];
+	size_t submodeslen, buffers;
+	int anonymous, dirty, load, job, follow, recording;
+} StatusKey;
+
 typedef struct Window {
-	int buffer;
-	int r, c, x, y;
+	BufId buffer;
+	int r, c, x, y;   /* screen area with status line, x and y from 0 */
+	View cur;
+	Layout *node;
+	BufId drawn;      /* buffer shown on screen, BUFNONE if none */
+	unsigned long drawnepoch; /* its epoch at that time */
+	unsigned long drawngen;   /* and its drawgen */
+	ssize_t top, xoff; /* first line and horizontal offset on screen */
+	char *status;     /* status line on screen, statuslen columns */
+	char *statnext;   /* next one is formatted here, then swapped */
+	int statuslen, statussplit;
+	StatusKey statkey; /* what parts below were made of */
+	String stathead, stattail; /* status line before and after position */
+	int statheadsplit;         /* width of mode part of stathead */
 } Window;
 
 typedef struct Binding {
@@ -121,17 +436,45 @@ typedef struct Binding {
 	size_t len;
 } Binding;
 
+/* descriptor polled while waiting for keys */
+typedef struct Watch {
+	int fd;
+	void (*func)(int fd, void *p);
+	void *p;
+} Watch;
+
+typedef struct CmdIndex {
+	String name;
+	const Command *cmd;
+} CmdIndex;
+
 /* prototypes */
+static Chunk *chunkNew(size_t siz);
+static void chunkFree(Chunk *c);
 static inline Line newLine(size_t siz);
+static Line lineDup(const char *s, size_t len);
+static inline Line lineRef(Line l);
+static inline void lineFree(Line *l);
+static void lineOwn(Line *l, size_t siz);
 /*********/
 static void rawOn(void);
 static void rawRestore(void);
-static void getws(int *r, int *c);
+static int getws(int *r, int *c);
+static void winchSignal(int sig);
+static void busSignal(int sig, siginfo_t *si, void *ctx);
+static void winchDone(int fd, void *p);
 /*********/
 static void termRefresh(void);
-static void appendRows(String *ab);
-static void appendContents(String *ab);
-static void appendStatus(String *ab);
+static void winDraw(String *ab, Window *w, int focused);
+static void appendSeparators(String *ab, const Layout *n);
+static ssize_t lineVis(const Line *l, size_t x);
+static inline int winWidth(const Window *w);
+static void cursorUpdate(void);
+static void appendRow(String *ab, const Window *w, Buffer *b, int row, ssize_t y, ssize_t xoff);
+static void statusCache(Window *w, Buffer *b);
+static int statusFormat(char *s, Window *w, Buffer *b, const View *v);
+static void appendStatus(String *ab, Window *w, Buffer *buf, const View *v,
+		int focused, int full);
 /*********/
 static void abAppend(String *ab, const char *str, size_t len);
 #define abPrintf(AB, CP, CPLEN, ...) \
@@ -143,17 +486,180 @@ static void editorParseKey(unsigned char key);
 static inline void edit(void);
 static inline void switchmode(Mode mode);
 /*********/
+static size_t winNew(BufId buf);
+static void winRestore(Window *w);
+static void winFocus(size_t i);
+static Layout *layoutLeaf(size_t win, Layout *parent);
+static void layoutApply(Layout *n, int y, int x, int r, int c);
+/*********/
 static Buffer createBuffer(void);
+static BufId bufNew(void);
+static Buffer *bufGet(BufId id);
+static BufId bufStep(BufId id, int dir);
+static BufId bufId(const Buffer *b);
+static void bufDel(BufId id);
 static void newBuffer(void);
-static void editBuffer(char *filename);
+static void bufferName(Buffer *b, const char *filename);
+static int fileRead(const char *path, Lines *lines, struct stat *sb);
+static char *idxPut(char *p, uint64_t n);
+static size_t idxHeader(char *p, const struct stat *sb);
+static int indexRead(const char *path, int fd, const struct stat *sb, Lines *lines);
+static void indexWrite(const char *path, const struct stat *sb, const Lines *lines);
+static int lineCheck(Buffer *b, size_t y);
+static int bufCheck(Buffer *b);
+static int indexStale(void);
+static char *pathDir(const char *path);
+static int fileChanged(const char *path, const struct stat *sb);
+static void fileWatch(Buffer *b);
+static void fileUnwatch(Buffer *b);
+static void fileEvents(int fd, void *p);
+static void fileCheck(BufId id);
+static void fileUpdate(Buffer *b);
+static void fileAnswer(int yes);
+static uint64_t fnv(const char *s, size_t n);
+static uint64_t lineHash(const Line *l);
+static inline int lineEq(const Line *a, const Line *b);
+static LineMatch *lineMatchGet(LineMatch *t, size_t mask, const Line *l);
+static void linesMatch(const Lines *old, const Lines *nw, ssize_t *map);
+static ssize_t lineMoved(const ssize_t *inv, size_t oldlen, size_t newlen, ssize_t y);
+static int fileReload(Buffer *b);
+static char *userDir(const char *var, const char *fallback);
+static char *userFile(const char *dir, const char *path);
+static void jnlNum(String *s, uint64_t n);
+static int jnlGetNum(const char **p, const char *end, uint64_t *n);
+static void jnlHeader(String *s, pid_t pid, const struct stat *sb);
+static char *jnlPath(const Buffer *b, int i);
+static int jnlOpen(const char *path, int flags);
+static Journal *jnlGet(Buffer *b);
+static void jnlText(Buffer *b, String *h, const char *s, size_t n);
+static void jnlChars(Buffer *b, size_t y, size_t x, const char *s, size_t n);
+static void jnlCut(Buffer *b, size_t y, size_t x1, size_t x2);
+static void jnlLine(Buffer *b, size_t y);
+static void jnlLines(Buffer *b, size_t at, size_t n);
+static void jnlDelete(Buffer *b, size_t at, size_t n);
+static void jnlOrder(Buffer *b, size_t at, size_t n, const size_t *order);
+static void jnlCopy(Buffer *b, size_t at, size_t y, size_t n, size_t times);
+static int jnlPut(Buffer *b);
+static int jnlDirect(Buffer *b, struct iovec *iov, int n);
+static void jnlFail(Buffer *b);
+static void jnlFlush(int sync);
+static void jnlEnd(Buffer *b);
+static size_t jnlReplay(Buffer *b, const char **pp, const char *end);
+static void jnlRecover(Buffer *b);
+static size_t chunkAppend(Lines *lines, Chunk *c, size_t len);
+static Chunk *chunkShrink(Chunk *c, size_t len);
+static BufId editBuffer(char *filename);
+static void *loaderThread(void *p);
+static void loaderDone(int fd, void *p);
+static void loaderStart(char **files, size_t n);
+static void watchAdd(int fd, void (*func)(int, void *), void *p);
+static void watchDel(int fd);
+static BufId jobOpen(Job *j, char *path);
+static void jobStart(const char *cmd, size_t len);
+static void stdinStart(int fd);
+static void jobRead(int fd, void *p);
+static void jobEnd(Job *j);
+static void bufTail(BufId id, ssize_t last, int focused);
+static void followRead(int fd, void *p);
+static int followStart(BufId id);
+static void followEnd(Follow *f);
+static void followReopen(Follow *f, const struct stat *sb);
 static void freeBuffer(Buffer *buf);
-static int writeBuffer(Buffer *buf, char *filename);
+static void bufLog(Buffer *b, size_t at, size_t end, int shift);
+static void bufTouch(Buffer *b, size_t y);
+static void bufShift(Buffer *b, size_t at, size_t end);
+static int bufLoading(const Buffer *b);
+static size_t bufChangedSince(const Buffer *b, unsigned long epoch, size_t *shifted);
+static size_t bufTailSince(const Buffer *b, unsigned long epoch);
+static inline int lineChangedSince(const Buffer *b, size_t y,
+		unsigned long gen, size_t shifted);
+static size_t bytesSum(const Buffer *b, size_t y);
+static void bytesSync(Buffer *b);
+static size_t bytesBefore(Buffer *b, size_t y);
+static ssize_t bytesLine(Buffer *b, size_t off, size_t *x);
+static uint32_t wordFind(const char *s, size_t n, int create);
+static uint32_t wordPrune(uint32_t i, const char *s, size_t n);
+static void wordsSpan(String s, int d);
+static void wordsLine(const Line *l, int d);
+static void wordsAround(const Line *l, size_t x1, size_t x2, int d);
+static void wordsCount(WordJob *j);
+static void *wordsThread(void *p);
+static void wordsFree(WordJob *j);
+static void wordsDone(int fd, void *p);
+static void wordsRun(WordJob *j);
+static void wordsPair(Buffer *b, WordJob *j, size_t y);
+static void wordsSync(Buffer *b);
+static void wordsSyncAll(void);
+static void wordsDrop(Buffer *b);
+static void wordsCollect(uint32_t i, char *w, size_t n);
+static inline int tagIdent(char c);
+static inline int tagIdle(const TagScan *st);
+static void tagAdd(Tags *t, const TagName *n, const TagScan *st);
+static void tagLine(TagScan *st, const Line *l, size_t y, Tags *out);
+static void tagDir(TagJob *j, const char *dir, int depth);
+static int tagCompare(const void *a, const void *b);
+static void *tagThread(void *p);
+static void tagsFree(Tags *t);
+static void tagMore(Buffer *b, TagJob *j);
+static void tagStart(TagJob *j);
+static void tagDone(int fd, void *p);
+static void tagSync(BufId id);
+static void tagSyncAll(void);
+static const Tag *tagFind(const char *name, size_t n, BufId *id);
+static void tagGo(const char *name, size_t n);
+static const Syntax *synDetect(const Buffer *b);
+static int synLex(const Syntax *s, const Line *l, int state, unsigned char *hl);
+static int synLine(Buffer *b, size_t y, int state);
+static void synSync(Buffer *b, size_t from, size_t upto);
+static inline int markGet(Buffer *b, size_t y);
+static void markToggle(Buffer *b, size_t y);
+static size_t markCount(Buffer *b);
+static ssize_t markNext(Buffer *b, ssize_t y, int dir);
+static unsigned long marksWord(Buffer *b, size_t pos);
+static void marksTrim(Buffer *b);
+static void marksInsert(Buffer *b, size_t at, size_t n);
+static void marksDelete(Buffer *b, size_t at, size_t n);
+static Line *linesInsert(Buffer *b, size_t at, size_t n);
+static void linesCopy(Buffer *b, size_t at, const Line *src, size_t n, size_t times);
+static void linesSplice(Buffer *b, size_t at, const Register *r, size_t times);
+static void linesDelete(Buffer *b, size_t at, size_t n);
+static size_t linesDeleteMarked(Buffer *b);
+static void charsReplace(Buffer *b, size_t y, size_t x1, size_t x2, const char *s, size_t n);
+static void charsDelete(Buffer *b, size_t y, size_t x1, size_t x2);
+static void charsInsert(Buffer *b, size_t y, size_t x, const char *s, size_t n);
+static void sortKey(SortKey *k, const Line *l, size_t i, int flags, size_t field);
+static void sortPrefix(SortKey *keys, size_t n);
+static inline int sortCompare(const SortKey *a, const SortKey *b, int flags);
+static void sortMerge(SortKey *dst, const SortKey *a, size_t na,
+		const SortKey *b, size_t nb, int flags);
+static void sortRun(SortKey *a, SortKey *tmp, size_t n, int flags);
+static void *sortThread(void *p);
+static void sortJobs(SortJob *jobs, size_t n);
+static void sortKeys(SortKey *keys, size_t n, int flags);
+static Register *regGet(int name);
+static void regFree(Register *r);
+static void regYankLines(Register *r, Buffer *b, const IArg *ia);
+static void regYankChars(Register *r, Buffer *b, size_t y, size_t x1, size_t x2);
+static int writeLines(int fd, Buffer *b, const IArg *ia);
+static int writevAll(int fd, struct iovec *iov, int n);
+static int writeBuffer(Buffer *buf, char *filename, const IArg *ia, int force);
 static int minibufferPrint(const char *s);
 static int minibufferError(const char *s);
+static void motionFail(const char *s);
 static inline int submodePush(Buffer *b, Mode m);
 static inline int submodePop(Buffer *b);
 /*********/
-static void setup(char *filename);
+static int cmdIndexCompare(const void *a, const void *b);
+static void cmdIndexBuild(void);
+static const Command *cmdLookup(String name);
+static int cmdParseAddr(String *s, ssize_t *out);
+static int cmdParseRange(String *s, IArg *ia);
+static int cmdParseRegister(IArg *ia);
+static int cmdParseCount(IArg *ia);
+static ssize_t rangeFirst(const IArg *ia);
+static ssize_t rangeNext(const IArg *ia, ssize_t y);
+/*********/
+static void setup(char **files, size_t n);
 static void finish(void);
 static void usage(void);
 /*********/
@@ -166,48 +672,188 @@ static void replacemode(const Arg *arg);
 static void globalsubmode(const Arg *arg);
 static void buffermode(const Arg *arg);
 static void commandmode(const Arg *arg);
-static void cursormove(const Arg *arg);
-static void beginning(const Arg *arg);
-static void ending(const Arg *arg);
-static void findchar(const Arg *arg);
+static void countprefix(const Arg *arg, const IArg *iarg);
+static void cursormove(const Arg *arg, const IArg *iarg);
+static void beginning(const Arg *arg, const IArg *iarg);
+static void ending(const Arg *arg, const IArg *iarg);
+static void findchar(const Arg *arg, const IArg *iarg);
 static void insertchar(const Arg *arg, const IArg *iarg);
 static void replacechar(const Arg *arg, const IArg *iarg);
 static void removechar(const Arg *arg);
-static void openline(const Arg *arg);
+static void complete(const Arg *arg, const IArg *iarg);
+static void openline(const Arg *arg, const IArg *iarg);
 static void deletelinecontent(const Arg *arg);
-static void deleteline(const Arg *arg);
-static void changeline(const Arg *arg);
-static void togglemark(const Arg *arg);
+static void deleteline(const Arg *arg, const IArg *iarg);
+static void changeline(const Arg *arg, const IArg *iarg);
+static void operator(const Arg *arg, const IArg *iarg);
+static void oplinewise(const Arg *arg, const IArg *iarg);
+static void regselect(const Arg *arg, const IArg *iarg);
+static void macrorecord(const Arg *arg, const IArg *iarg);
+static void macroplay(const Arg *arg, const IArg *iarg);
+static void put(const Arg *arg, const IArg *iarg);
+static void togglemark(const Arg *arg, const IArg *iarg);
+static void markjump(const Arg *arg, const IArg *iarg);
 static void execcmd(const Arg *arg);
 static void cmdinsertchar(const Arg *arg, const IArg *iarg);
 static void cmdremovechar(const Arg *arg);
+static void delete(const Arg *arg, const IArg *iarg);
+static void yank(const Arg *arg, const IArg *iarg);
+static void cmdput(const Arg *arg, const IArg *iarg);
+static void substitute(const Arg *arg, const IArg *iarg);
 static void shell(const Arg *arg, const IArg *iarg);
+static void filter(const Arg *arg, const IArg *iarg);
+static void sort(const Arg *arg, const IArg *iarg);
+static void follow(const Arg *arg);
+static void gotobyte(const Arg *arg, const IArg *iarg);
+static void tag(const Arg *arg, const IArg *iarg);
+static void tagindex(const Arg *arg, const IArg *iarg);
+static void tagjump(const Arg *arg);
 static void bufwriteclose(const Arg *arg);
-static void bufwrite(const Arg *arg);
+static void bufwrite(const Arg *arg, const IArg *iarg);
 static void bufclose(const Arg *arg);
 static void bufkill(const Arg *arg);
+static void buflist(const Arg *arg, const IArg *iarg);
+static void bufswitch(const Arg *arg, const IArg *iarg);
+static void winsplit(const Arg *arg);
+static void winclose(const Arg *arg);
+static void winnext(const Arg *arg, const IArg *iarg);
 
 /* global variables */
 static struct {
 	struct termios origtermios;
-	Array(Buffer) buffers;
+	struct {
+		Slot *data;
+		size_t len;
+		size_t free;  /* first free slot, 0 if none */
+		size_t count; /* open buffers, without fallback one */
+	} buffers;
 	Array(Window) windows;
+	Layout *layout;
 	int focusedwin;
 	int r, c;
 	String cmd;
+	size_t count;
+	Motion motion;
+	Register regs[REGISTERS];
+	int reg; /* register selected with "x, 0 if none */
+	String macros[MACROS];
+	int recording, lastmacro; /* macro names, 0 if none */
+	String input; /* queued keys of replayed macro */
+	int replaying, failed;
+	int redraw; /* screen was overwritten, everything has to be drawn */
+	Array(Watch) watches;
+	int winch[2]; /* written to on SIGWINCH */
+	int inotify;  /* changes of files of buffers, -1 if not watched */
+	int zero;     /* /dev/zero, -1 if files are not mapped */
+	uintptr_t pagesize;
+	BufId reload; /* buffer asked about reloading, BUFNONE if none */
+	char *jnldir; /* directory of journals, NULL if none are kept */
+	char *idxdir; /* directory of line indexes, NULL if none are kept */
+	int recovering, unsynced;
+	struct {
+		pthread_mutex_t lock;
+		Array(WordNode) nodes;
+		uint32_t free; /* nodes taken out, a list through next[0] */
+		int pipe[2]; /* finished jobs are written to it */
+	} words;
+	struct {
+		BufId buf;
+		ssize_t y;
+		size_t x, len;       /* word put in place of typed one */
+		Array(char *) cands; /* candidates, typed word last */
+		size_t i;            /* candidate put */
+	} completion;
+	struct {
+		int pipe[2];  /* finished jobs are written to it */
+		Tags dir;     /* tags of files in directory, by name */
+		Array(char *) files; /* their paths */
+		int scanning; /* directory is being scanned */
+	} tags;
+	struct {
+		pthread_mutex_t lock;
+		Load **jobs;
+		size_t len, next, done;
+		int pipe[2]; /* finished jobs are written to it */
+	} loader;
 } be;
 
 const Arg nullarg = {.i = 0};
+const IArg nulliarg = {0};
 char *argv0;
 
 /* config */
 #include "config.h"
 
+static CmdIndex cmdindex[LEN(commands) * 2];
+static size_t cmdindexlen;
+
 /* constructors */
+static Chunk *
+chunkNew(size_t siz)
+{
+	Chunk *c = malloc(sizeof *c + siz);
+	c->ref = 0;
+	c->map = 0;
+	return c;
+}
+
+static void
+chunkFree(Chunk *c)
+{
+	char *map;
+	if (c->map) {
+		memcpy(&map, c->data, sizeof map);
+		munmap(map, c->map);
+	}
+	free(c);
+}
+
 static inline Line
 newLine(size_t siz)
 {
-	return (Line){ malloc(siz), 0, 0 };
+	Chunk *c = chunkNew(siz);
+	c->ref = 1;
+	return (Line){ c->data, 0, c, 0, SYNSTALE, SynNormal };
+}
+
+static Line
+lineDup(const char *s, size_t len)
+{
+	Line l = newLine(len);
+	memcpy(l.data, s, l.len = len);
+	return l;
+}
+
+static inline Line
+lineRef(Line l)
+{
+	++(l.chunk->ref);
+	return l;
+}
+
+static inline void
+lineFree(Line *l)
+{
+	if (!--(l->chunk->ref))
+		chunkFree(l->chunk);
+}
+
+/* makes line storage private and at least siz bytes long;
+   shared storage is copied here, and only here */
+static void
+lineOwn(Line *l, size_t siz)
+{
+	Chunk *c;
+	if (siz < l->len) siz = l->len;
+	if (l->chunk->ref == 1 && l->data == l->chunk->data) {
+		c = realloc(l->chunk, sizeof *c + siz);
+	} else {
+		c = chunkNew(siz);
+		c->ref = 1;
+		memcpy(c->data, l->data, l->len);
+		lineFree(l);
+	}
+	l->data = (l->chunk = c)->data;
 }
 
 /* terminal */
@@ -236,16 +882,75 @@ rawRestore(void)
 		die("tcsetattr:");
 }
 
-static void
+/* gets screen size, returns -1 if it is too small */
+static int
 getws(int *r, int *c)
 {
 	struct winsize ws;
 	if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) < 0)
 		die("ioctl:");
 	if (ws.ws_col < 20 || ws.ws_row < 3)
-		die(lang_err[ErrScreenTooSmall], 20, 3);
+		return -1;
 	*c = ws.ws_col;
 	*r = ws.ws_row;
+	return 0;
+}
+
+/* file mapped for lines of buffer may be cut short by someone else;
+   its pages past new end then read as zeros instead of killing editor,
+   until change of file is noticed and it is read again */
+static void
+busSignal(int sig, siginfo_t *si, void *ctx)
+{
+	char *page = (char *)((uintptr_t)si->si_addr & ~(be.pagesize - 1));
+	(void)ctx;
+	if (mmap(page, be.pagesize, PROT_READ, MAP_PRIVATE | MAP_FIXED, be.zero, 0)
+			== MAP_FAILED) {
+		signal(sig, SIG_DFL);
+		raise(sig);
+	}
+}
+
+/* resizing: signal handler only writes to pipe, which is watched
+   like other descriptors, so it is handled between keys */
+static void
+winchSignal(int sig)
+{
+	int e = errno;
+	ssize_t wb;
+	(void)sig;
+	/* write fails only if pipe is full, then resize is pending anyway */
+	wb = write(be.winch[1], "", 1);
+	(void)wb;
+	errno = e;
+}
+
+static void
+winchDone(int fd, void *p)
+{
+	char buf[64];
+	struct pollfd pfd;
+	int r, c, n;
+	(void)p;
+
+	/* terminal sends signals all the time it is being resized,
+	   so layout is computed once they stop coming */
+	pfd = (struct pollfd){ fd, POLLIN, 0 };
+	for (;;) {
+		while (read(fd, buf, sizeof buf) > 0);
+		if (!(n = poll(&pfd, 1, resizedelay)))
+			break;
+		if (n < 0 && errno != EINTR)
+			die("poll:");
+	}
+	if (getws(&r, &c) < 0 || (r == be.r && c == be.c))
+		return;
+	be.r = r;
+	be.c = c;
+	/* lines keep their lexer state, only screen is drawn again */
+	layoutApply(be.layout, 0, 0, be.r - 1, be.c);
+	if (write(STDOUT_FILENO, "\033[2J", 4) != 4)
+		die("write:");
 }
 
 /* output */
@@ -253,136 +958,346 @@ static void
 termRefresh(void)
 {
 	String ab = { NULL, 0 };
-	char cp[24];
+	char cp[40];
+	size_t i;
 
-	abAppend(&ab, "\033[?25l\033[H", 9);
-	appendRows(&ab);
-	appendContents(&ab);
-	appendStatus(&ab);
-	abPrintf(&ab, cp, 24, "\033[%4d;%4ldH\033[?25h\033[%c q",
-			FOCUSPOINT, (CURBUF.xvis - CURBUF.xoff) + 1,
+	cursorUpdate();
+	/* synchronized update, so terminal shows whole frames only */
+	abAppend(&ab, "\033[?2026h\033[?25l", 14);
+	if (be.redraw)
+		appendSeparators(&ab, be.layout);
+	for (i = 0; i < be.windows.len; ++i)
+		winDraw(&ab, be.windows.data + i, i == (size_t)be.focusedwin);
+	if (CURBUF.mode == ModeCommand) {
+		abPrintf(&ab, cp, 40, "\033[%4d;0H\033[0m\033[K:", be.r);
+		abAppend(&ab, be.cmd.data, be.cmd.len);
+	} else {
+		abPrintf(&ab, cp, 40, "\033[%4d;%4ldH",
+				CURWIN.y + FOCUSPOINT(&CURWIN),
+				CURWIN.x + (CURBUF.xvis - CURBUF.xoff) + 1);
+	}
+	abPrintf(&ab, cp, 40, "\033[?25h\033[%c q",
 			CURBUF.mode == ModeEdit ? '5' : '1');
-	if (CURBUF.mode == ModeCommand)
-		abPrintf(&ab, cp, 24, "\033[%4d;%4ldH",
-				be.r, (be.cmd.len) + 2);
+	abAppend(&ab, "\033[?2026l", 8);
 
 	if ((unsigned)write(STDOUT_FILENO, ab.data, ab.len) != ab.len)
 		die("write:");
 
 	abFree(&ab);
+	be.redraw = 0;
+	/* lines drawn showed index of some file to be wrong */
+	if (indexStale())
+		termRefresh();
 }
 
+/* draws window, or only its lines which changed or scrolled in
+   since it was drawn last time */
 static void
-appendRows(String *ab)
+winDraw(String *ab, Window *w, int focused)
 {
-	size_t y;
-	for (y = 0; y < (unsigned)(CURWIN.r - 1); ++y)
-		abAppend(ab, "\033[K~\r\n", (y < (unsigned)(CURWIN.r - 1)) ? 6 : 4);
+	char cp[40];
+	Buffer *b = &(be.buffers.data[BUFSLOT(w->buffer)].b);
+	View v;
+	ssize_t top, delta, y;
+	size_t shifted;
+	int row, rows, full;
+
+	/* screen could get too small for all windows */
+	if (w->r < 1 || w->c < 1)
+		return;
+	v = focused ? (View){ b->x, b->y, b->xvis, b->xoff } : w->cur;
+	if (v.y >= (ssize_t)b->lines.len)
+		v.y = (ssize_t)b->lines.len - 1;
+	top = v.y - FOCUSPOINT(w);
+	rows = w->r - 1;
+	delta = top - w->top;
+	if (top + rows >= 0)
+		synSync(b, (size_t)MAX(top + 1, 0), (size_t)(top + rows));
+
+	full = be.redraw || w->drawn != w->buffer;
+	/* terminals scroll whole rows, so only full width windows can
+	   let them do it */
+	if (full || w->xoff != v.xoff || delta >= rows || -delta >= rows
+	|| (delta && (w->x || w->c != be.c))) {
+		for (row = 1; row <= rows; ++row)
+			appendRow(ab, w, b, row, top + row, v.xoff);
+	} else {
+		/* viewport moved by few lines: let the terminal scroll
+		   the rows region, then draw exposed and changed lines */
+		if (delta)
+			abPrintf(ab, cp, 40, "\033[%d;%dr\033[%ld%c\033[r",
+					w->y + 1, w->y + rows,
+					delta > 0 ? delta : -delta, delta > 0 ? 'S' : 'T');
+		shifted = SIZE_MAX;
+		if (b->epoch != w->drawnepoch)
+			bufChangedSince(b, w->drawnepoch, &shifted);
+		for (row = 1; row <= rows; ++row) {
+			y = top + row;
+			if ((delta > 0 && row > rows - delta) || (delta < 0 && row <= -delta)
+			||  (y >= 0 && (size_t)y < b->lines.len
+			     ? lineChangedSince(b, (size_t)y, w->drawngen, shifted)
+			     : y >= 0 && (size_t)y >= shifted))
+				appendRow(ab, w, b, row, y, v.xoff);
+		}
+	}
+	appendStatus(ab, w, b, &v, focused, full);
+	w->top = top;
+	w->xoff = v.xoff;
+	w->drawn = w->buffer;
+	w->drawnepoch = b->epoch;
+	w->drawngen = b->drawgen;
 }
 
+/* column lines between windows side by side */
 static void
-appendContents(String *ab)
+appendSeparators(String *ab, const Layout *n)
 {
-	ssize_t y, x, xvis;
-	int xvf; /* xvis flag */
-	char cp[19], c;
-	String printl;
+	char cp[24];
+	int row;
+	if (n->split == SplitNone)
+		return;
+	if (n->split == SplitColumns)
+		for (row = 1; row <= n->r; ++row)
+			abPrintf(ab, cp, 24, "\033[%4d;%4dH\033[0m|",
+					n->y + row, n->child[1]->x);
+	appendSeparators(ab, n->child[0]);
+	appendSeparators(ab, n->child[1]);
+}
 
-	for (y = 0; y < CURWIN.r; ++y) {
-		printl.data = malloc(printl.len = 0);
-		if ((unsigned)(y + CURBUF.y - FOCUSPOINT) < CURBUF.lines.len) {
-			abPrintf(ab, cp, 19, "\033[%4ld;0H\033[K", y);
-			xvf = (y + CURBUF.y - FOCUSPOINT == CURBUF.y) ? 1 : 0;
-			xvis = 0;
-			if (xvf) CURBUF.xvis = xvis;
-			if (CURBUF.lines.data[y + CURBUF.y - FOCUSPOINT].isMarked)
-				abAppend(&printl, "\033[34m", 5);
-			else
-				abAppend(&printl, "\033[0m", 4);
-			for (x = 0; x < (signed)CURBUF.lines.data[y + CURBUF.y - FOCUSPOINT].len; ++x) {
-				c = CURBUF.lines.data[y + CURBUF.y - FOCUSPOINT].data[x];
-				if (isprint(c)) {
-					/* printable */
-					abAppend(&printl, &c, 1);
-					++xvis;
-				} else if (c < 0) {
-					/* unicode */
-					/* FIXME: partially broken with horiz. scrolling */
-					size_t bytes;
-					if ((unsigned)((c >> 5) & 0x07) == 0x06) bytes = 2;
-					else if ((unsigned)((c >> 4) & 0x0f) == 0x0e) bytes = 3;
-					else if ((unsigned)((c >> 3) & 0x1f) == 0x1e) bytes = 4;
-					else bytes = 1;
-					abAppend(&printl, CURBUF.lines.data[y + CURBUF.y - FOCUSPOINT].data + x, bytes);
-					++xvis;
-					x += (signed)bytes - 1;
-				} else {
-					/* control chars */
-					if (c == '\t') {
-						unsigned int tw;
-						for (tw = 0; tw < tabwidth; ++tw)
-							abAppend(&printl, &indentationchar, 1);
-						xvis += (signed)tabwidth;
-					} else {
-						abAppend(&printl, "^", 1);
-						c = c ^ 0x40;
-						abAppend(&printl, &c, 1);
-						xvis += 2;
-					}
-				}
-				if (xvf && x < CURBUF.x) CURBUF.xvis = xvis;
-			}
-			if (CURBUF.xvis + CURBUF.xoff > (CURWIN.c - 1))
-				CURBUF.xoff = CURBUF.xvis - (CURWIN.c - 1);
-			else
-				CURBUF.xoff = 0;
-			if ((signed)printl.len - CURBUF.xoff > 0)
-				abAppend(ab,
-						(printl.data) + CURBUF.xoff,
-						(unsigned)MIN((signed)printl.len - CURBUF.xoff, CURWIN.c - 1));
+/* number of screen columns taken by first x bytes of line */
+static ssize_t
+lineVis(const Line *l, size_t x)
+{
+	size_t i;
+	ssize_t xvis;
+	char c;
+	for (i = 0, xvis = 0; i < x && i < l->len; ++i) {
+		c = l->data[i];
+		if (isprint(c) || c < 0) {
+			/* continuation bytes of unicode take no column */
+			if ((c & 0xc0) != 0x80) ++xvis;
+		} else if (c == '\t') {
+			xvis += (ssize_t)tabwidth;
+		} else {
+			xvis += 2;
 		}
-		free(printl.data);
 	}
+	return xvis;
+}
+
+/* columns of window used for text; last column of screen is left
+   empty, so writing it does not wrap */
+static inline int
+winWidth(const Window *w)
+{
+	return w->x + w->c >= be.c ? w->c - 1 : w->c;
+}
+
+static void
+cursorUpdate(void)
+{
+	CURBUF.xvis = lineVis(CURBUF.lines.data + CURBUF.y, (size_t)CURBUF.x);
+	if (CURBUF.xvis + CURBUF.xoff > winWidth(&CURWIN))
+		CURBUF.xoff = CURBUF.xvis - winWidth(&CURWIN);
+	else
+		CURBUF.xoff = 0;
 }
 
+/* draws line y of buffer on row of window, columns [xoff, xoff + width) */
 static void
-appendStatus(String *ab)
+appendRow(String *ab, const Window *w, Buffer *b, int row, ssize_t y, ssize_t xoff)
 {
-	char cp[256];
-	ssize_t i;
-	i = -1;
-	abPrintf(ab, cp, 256, "\033[%4d;0H\033[K",
-			(unsigned)(CURWIN.r));
-	while (++i < CURWIN.c) {
-		abAppend(ab, " ", 1);
+	char cp[32], c;
+	const Line *l;
+	size_t x, bytes;
+	int width = winWidth(w);
+	ssize_t col, end = xoff + width;
+	unsigned int tw;
+	unsigned char *hl = NULL, cur = HlNormal;
+
+	/* windows not reaching right edge erase only their columns */
+	if (w->x + w->c >= be.c)
+		abPrintf(ab, cp, 32, "\033[%4d;%4dH\033[0m\033[K", w->y + row, w->x + 1);
+	else
+		abPrintf(ab, cp, 32, "\033[%4d;%4dH\033[0m\033[%dX",
+				w->y + row, w->x + 1, w->c);
+	if (y < 0 || (size_t)y >= b->lines.len) {
+		abAppend(ab, "~", 1);
+		return;
 	}
-	abAppend(ab, "\r", 1);
-	/* status drawing */
-	{
-		abPrintf(ab, cp, 256, "\033[1;33;7m %s", lang_modes[CURBUF.mode]);
-		for (i = 0; i < (signed)CURBUF.submodeslen; ++i) {
-			abPrintf(ab, cp, 256, "/%s",
-					lang_modes[CURBUF.submodes[i]]
-			);
-		}
-		abPrintf(ab, cp, 256, " \033[0m %s | %c:%c L%ld/%ld | C%ld-%ld/%ld | %ld buffer(s)\033[0m",
-				CURBUF.anonymous ?
-					"*anonymous*" : CURBUF.name,
-				CURBUF.anonymous ? 'U' : '-',
-				CURBUF.dirty ? '*' : '-',
-				CURBUF.y + 1,
-				CURBUF.lines.len,
-				CURBUF.x + 1,
-				CURBUF.xvis + 1,
-				CURBUF.lines.data[CURBUF.y].len,
-				be.buffers.len - 1
+	lineCheck(b, (size_t)y);
+	l = b->lines.data + y;
+	if (markGet(b, (size_t)y))
+		abAppend(ab, "\033[34m", 5);
+	else if (b->syntax && (hl = malloc(l->len + 1)))
+		synLex(b->syntax, l, l->hlin == SYNSTALE ? SynNormal : l->hlin, hl);
+	for (x = 0, col = 0; x < l->len && col < end; ++x) {
+		if (hl && hl[x] != cur) {
+			cur = hl[x];
+			abAppend(ab, highlights[cur], strlen(highlights[cur]));
+		}
+		c = l->data[x];
+		if (isprint(c)) {
+			/* printable */
+			if (col++ >= xoff)
+				abAppend(ab, &c, 1);
+		} else if (c < 0) {
+			/* unicode */
+			if ((unsigned)((c >> 5) & 0x07) == 0x06) bytes = 2;
+			else if ((unsigned)((c >> 4) & 0x0f) == 0x0e) bytes = 3;
+			else if ((unsigned)((c >> 3) & 0x1f) == 0x1e) bytes = 4;
+			else bytes = 1;
+			if (bytes > l->len - x) bytes = l->len - x;
+			if (col++ >= xoff)
+				abAppend(ab, l->data + x, bytes);
+			x += bytes - 1;
+		} else if (c == '\t') {
+			/* control chars */
+			for (tw = 0; tw < tabwidth && col < end; ++tw)
+				if (col++ >= xoff)
+					abAppend(ab, &indentationchar, 1);
+		} else {
+			if (col++ >= xoff)
+				abAppend(ab, "^", 1);
+			c = c ^ 0x40;
+			if (col < end && col++ >= xoff)
+				abAppend(ab, &c, 1);
+		}
+	}
+	free(hl);
+}
+
+/* makes parts of status line of window which do not depend on cursor
+   again, if anything they show changed since they were made */
+static void
+statusCache(Window *w, Buffer *b)
+{
+	char cp[48];
+	StatusKey k;
+	size_t i, m;
+
+	memset(&k, 0, sizeof k);
+	k.buf = w->buffer;
+	k.name = b->name;
+	k.epoch = b->epoch;
+	k.drawgen = b->drawgen;
+	k.mode = b->mode;
+	memcpy(k.submodes, b->submodes, b->submodeslen * sizeof *(b->submodes));
+	k.submodeslen = b->submodeslen;
+	k.buffers = be.buffers.count;
+	k.anonymous = b->anonymous;
+	k.dirty = b->dirty;
+	k.load = b->load != NULL;
+	k.job = b->job != NULL;
+	k.follow = b->follow != NULL;
+	k.recording = be.recording;
+	if (w->stathead.data && !memcmp(&k, &w->statkey, sizeof k))
+		return;
+	memcpy(&w->statkey, &k, sizeof k);
+
+	w->stathead.len = w->stattail.len = 0;
+	abPrintf(&w->stathead, cp, 48, " %s", lang_modes[b->mode]);
+	for (i = 0; i < b->submodeslen; ++i)
+		abPrintf(&w->stathead, cp, 48, "/%s", lang_modes[b->submodes[i]]);
+	abAppend(&w->stathead, " ", 1);
+	w->statheadsplit = (int)w->stathead.len;
+	abAppend(&w->stathead, " ", 1);
+	if (b->name)
+		abAppend(&w->stathead, b->name, strlen(b->name));
+	else
+		abAppend(&w->stathead, "*anonymous*", 11);
+	abPrintf(&w->stathead, cp, 48, " | %c:%c ",
+			b->anonymous ? 'U' : '-', b->dirty ? '*' : '-');
+
+	abPrintf(&w->stattail, cp, 48, " | %lu buffer(s)",
+			(unsigned long)be.buffers.count);
+	if (b->load)
+		abAppend(&w->stattail, " | loading", 10);
+	if (b->job)
+		abAppend(&w->stattail, " | running", 10);
+	if (b->follow)
+		abAppend(&w->stattail, " | following", 12);
+	if ((m = markCount(b)))
+		abPrintf(&w->stattail, cp, 48, " | %lu marked", (unsigned long)m);
+	if (be.recording)
+		abPrintf(&w->stattail, cp, 48, " | recording @%c", be.recording);
+}
+
+/* formats status line of buffer viewed at v in window into exactly
+   its width columns of s, returns width of its highlighted (mode)
+   part; only cursor position is formatted every time */
+static int
+statusFormat(char *s, Window *w, Buffer *b, const View *v)
+{
+	int n, t, width = w->c;
+
+	statusCache(w, b);
+	n = MIN((int)w->stathead.len, width);
+	memcpy(s, w->stathead.data, (size_t)n);
+	if (n < width)
+		n += snprintf(s + n, (size_t)(width - n) + 1,
+				"L%ld/%ld | C%ld-%ld/%ld | B%lu",
+				v->y + 1,
+				b->lines.len,
+				v->x + 1,
+				v->xvis + 1,
+				b->lines.data[v->y].len,
+				(unsigned long)(bytesBefore(b, (size_t)v->y)
+					+ (size_t)v->x + 1)
 		);
+	n = MIN(n, width);
+	t = MIN((int)w->stattail.len, width - n);
+	memcpy(s + n, w->stattail.data, (size_t)t);
+	n += t;
+	if (n < width)
+		memset(s + n, ' ', (size_t)(width - n));
+	return MIN(w->statheadsplit, width);
+}
+
+/* draws status line of window, or only the columns which differ
+   from the ones already on screen */
+static void
+appendStatus(String *ab, Window *w, Buffer *buf, const View *v,
+		int focused, int full)
+{
+	char cp[24], *s;
+	int a, b, split;
+
+	if (w->statuslen != w->c) {
+		free(w->statnext);
+		w->statnext = malloc((size_t)w->c + 1);
 	}
-	abAppend(ab, "\r\033[0m", 6);
-	if (CURBUF.mode == ModeCommand) {
-		abAppend(ab, "\r\n\033[K:", 6);
-		abAppend(ab, be.cmd.data, be.cmd.len);
+	s = w->statnext;
+	split = statusFormat(s, w, buf, v);
+	if (full || w->statuslen != w->c || w->statussplit != split) {
+		a = 0;
+		b = w->c;
+	} else {
+		for (a = 0; a < w->c && s[a] == w->status[a]; ++a);
+		for (b = w->c; b > a && s[b - 1] == w->status[b - 1]; --b);
+	}
+	if (a < b) {
+		abPrintf(ab, cp, 24, "\033[%4d;%4dH", w->y + w->r, w->x + a + 1);
+		if (a < split) {
+			if (focused)
+				abAppend(ab, "\033[0;1;33;7m", 11);
+			else
+				abAppend(ab, "\033[0;7m", 6);
+			abAppend(ab, s + a, (size_t)(MIN(b, split) - a));
+		}
+		abAppend(ab, "\033[0m", 4);
+		if (b > split)
+			abAppend(ab, s + MAX(a, split), (size_t)(b - MAX(a, split)));
 	}
+	if (w->statuslen != w->c) {
+		/* other one is of old width, it is made again next time */
+		free(w->status);
+		w->status = malloc((size_t)w->c + 1);
+	}
+	w->statnext = w->status;
+	w->status = s;
+	w->statuslen = w->c;
+	w->statussplit = split;
 }
 
 /* append buffer */
@@ -390,7 +1305,7 @@ static void
 abAppend(String *ab, const char *str, size_t len)
 {
 	char *nb;
-	if ((nb = realloc(ab->data, ab->len + len)) == NULL)
+	if (!len || (nb = realloc(ab->data, ab->len + len)) == NULL)
 		return;
 	memcpy((ab->data = nb) + ab->len, str, len);
 	ab->len += len;
@@ -408,11 +1323,55 @@ editorGetKey(void)
 {
 	ssize_t rb;
 	unsigned char c;
+	struct pollfd *fds;
+	size_t i, j, n;
+	int r, in;
 
+	/* replayed keys are dispatched without drawing anything */
+	if (be.input.len) {
+		--(be.input.len);
+		return (unsigned char)*(be.input.data++);
+	}
 	termRefresh();
-	while ((rb = read(STDIN_FILENO, &c, 1)) != 1)
+	for (;;) {
+		fds = malloc((be.watches.len + 1) * sizeof *fds);
+		fds[0] = (struct pollfd){ STDIN_FILENO, POLLIN, 0 };
+		for (i = 0; i < be.watches.len; ++i)
+			fds[i + 1] = (struct pollfd){ be.watches.data[i].fd, POLLIN, 0 };
+		n = be.watches.len;
+		jnlFlush(0);
+		wordsSyncAll();
+		tagSyncAll();
+		while ((r = poll(fds, n + 1, be.unsynced ? journaldelay : -1)) < 0)
+			if (errno != EINTR && errno != EAGAIN)
+				die("poll:");
+		/* user is idle, journals are synced */
+		if (!r)
+			jnlFlush(1);
+		/* watches may be added or removed by the called functions */
+		for (i = 0; i < n; ++i)
+			if (fds[i + 1].revents)
+				for (j = 0; j < be.watches.len; ++j)
+					if (be.watches.data[j].fd == fds[i + 1].fd) {
+						be.watches.data[j].func(fds[i + 1].fd, be.watches.data[j].p);
+						break;
+					}
+		in = fds[0].revents;
+		rb = in ? read(STDIN_FILENO, &c, 1) : 0;
+		free(fds);
+		/* key typed, or end of input, answers question asked */
+		if (in && be.reload != BUFNONE) {
+			fileAnswer(rb == 1 && c == 'y');
+			rb = 0;
+		}
+		if (rb == 1)
+			break;
 		if (rb < 0 && errno != EAGAIN)
 			die("read:");
+		termRefresh();
+	}
+	if (be.recording)
+		abAppend(be.macros + (be.recording - 'a'), (char *)&c, 1);
 	return c;
 }
 
@@ -422,6 +1381,7 @@ editorParseKey(unsigned char key)
 	Binding *binds;
 	size_t i;
 	IArg ia = {.c = (char)key};
+	ia.n = be.count;
 	binds = &bindings[CURBUF.submodeslen ?
 		CURBUF.submodes[CURBUF.submodeslen - 1] : CURBUF.mode];
 	for (i = 0; i < binds->len; ++i)
@@ -429,6 +1389,13 @@ editorParseKey(unsigned char key)
 						& binds->keys[i].mod)
 		|| i == binds->len - 1) {
 			(binds->keys[i].func)(&(binds->keys[i].arg), &ia);
+			/* count and register are consumed by the first
+			   key which is not a prefix */
+			if (binds->keys[i].func != countprefix
+			&&  binds->keys[i].func != regselect) {
+				be.count = 0;
+				be.reg = 0;
+			}
 			return;
 		}
 }
@@ -436,7 +1403,7 @@ editorParseKey(unsigned char key)
 static inline void
 edit(void)
 {
-	while (be.buffers.len - 1) editorParseKey(editorGetKey());
+	while (be.buffers.count) editorParseKey(editorGetKey());
 }
 
 static inline void
@@ -445,130 +1412,3675 @@ switchmode(Mode mode)
 	CURBUF.mode = mode;
 }
 
+/* windows */
+/* layout of windows is a tree of splits, with windows in leaves */
+static size_t
+winNew(BufId buf)
+{
+	Window w;
+	Buffer *b = &(be.buffers.data[BUFSLOT(buf)].b);
+	w.buffer = buf;
+	w.r = w.c = w.x = w.y = 0;
+	w.cur = (View){ b->x, b->y, b->xvis, b->xoff };
+	w.node = NULL;
+	w.drawn = BUFNONE;
+	w.drawnepoch = w.drawngen = 0;
+	w.top = w.xoff = 0;
+	w.status = w.statnext = NULL;
+	w.statuslen = w.statussplit = 0;
+	w.stathead = (String){ NULL, 0 };
+	w.stattail = (String){ NULL, 0 };
+	pushVector(be.windows, w);
+	return be.windows.len - 1;
+}
+
+/* cursor of window goes back to its buffer when window gets focus,
+   lines could be deleted while it was kept in window */
+static void
+winRestore(Window *w)
+{
+	Buffer *b = &(be.buffers.data[BUFSLOT(w->buffer)].b);
+	b->y = w->cur.y < (ssize_t)b->lines.len ?
+		w->cur.y : (ssize_t)b->lines.len - 1;
+	b->x = w->cur.x < (ssize_t)b->lines.data[b->y].len ?
+		w->cur.x : (ssize_t)b->lines.data[b->y].len;
+	b->xoff = w->cur.xoff;
+	w->statuslen = 0;
+}
+
+/* moves focus to window i; cursor of window which loses it is kept
+   in the window, status lines of both are drawn again */
+static void
+winFocus(size_t i)
+{
+	if (i == (size_t)be.focusedwin)
+		return;
+	CURWIN.cur = (View){ CURBUF.x, CURBUF.y, CURBUF.xvis, CURBUF.xoff };
+	CURWIN.statuslen = 0;
+	be.focusedwin = (int)i;
+	winRestore(&CURWIN);
+}
+
+static Layout *
+layoutLeaf(size_t win, Layout *parent)
+{
+	Layout *n = calloc(1, sizeof *n);
+	n->split = SplitNone;
+	n->win = win;
+	n->parent = parent;
+	be.windows.data[win].node = n;
+	return n;
+}
+
+/* gives node and its windows the screen area */
+static void
+layoutApply(Layout *n, int y, int x, int r, int c)
+{
+	Window *w;
+	int a;
+	n->y = y; n->x = x; n->r = r; n->c = c;
+	if (n->split == SplitNone) {
+		w = be.windows.data + n->win;
+		w->y = y; w->x = x; w->r = r; w->c = c;
+		w->drawn = BUFNONE;
+	} else if (n->split == SplitRows) {
+		a = r / 2;
+		layoutApply(n->child[0], y, x, a, c);
+		layoutApply(n->child[1], y + a, x, r - a, c);
+	} else {
+		/* one column is left for separator */
+		a = (c - 1) / 2;
+		layoutApply(n->child[0], y, x, r, a);
+		layoutApply(n->child[1], y, x + a + 1, r, c - a - 1);
+	}
+	be.redraw = 1;
+}
+
 /* buffers */
 static Buffer
 createBuffer(void)
 {
 	Buffer b;
 	newVector(b.lines);
-	*b.path = *b.name = '\0';
+	b.path = NULL;
+	b.name = NULL;
+	newVector(b.marks);
 	b.anonymous = 1;
 	b.dirty = 0;
+	b.epoch = b.drawgen = 0;
+	b.nchanges = 0;
+	b.syntax = NULL;
+	b.synvalid = 0;
+	b.synepoch = 0;
+	newVector(b.bytes);
+	b.bytesepoch = 0;
+	newVector(b.words);
+	b.wordsepoch = 0;
+	newVector(b.tags);
+	b.tagepoch = 0;
+	b.taglen = 0;
+	b.tagged = 0;
+	b.tagjob = NULL;
+	memset(&b.sb, 0, sizeof b.sb);
+	b.wd = -1;
+	b.stale = 0;
+	b.load = NULL;
+	b.job = NULL;
+	b.follow = NULL;
+	b.jnl = NULL;
+	b.idxstale = 0;
 	b.x = b.y = b.xvis = b.xoff = 0;
 	b.mode = ModeNormal;
 	b.submodeslen = 0;
 	return b;
 }
 
-static void
-newBuffer(void)
+/* buffer table: opening, closing and switching buffers take constant
+   time; table may be reallocated when buffer is opened, so buffers are
+   referred to by handles, not pointers */
+static BufId
+bufNew(void)
 {
-	pushVector(be.buffers, createBuffer());
-	pushVector(be.buffers.data[be.buffers.len - 1].lines, newLine(0));
+	size_t i;
+	Slot *sl, *fb;
+	if ((i = be.buffers.free)) {
+		be.buffers.free = be.buffers.data[i].next;
+	} else {
+		i = be.buffers.len;
+		pushVector(be.buffers, ((Slot){ .gen = 0 }));
+	}
+	sl = be.buffers.data + i;
+	fb = be.buffers.data;
+	sl->b = createBuffer();
+	sl->live = 1;
+	/* opened last, so before fallback buffer in ring */
+	sl->next = 0;
+	sl->prev = fb->prev;
+	be.buffers.data[fb->prev].next = i;
+	fb->prev = i;
+	++be.buffers.count;
+	return BUFID(i, sl->gen);
 }
 
-static void
-editBuffer(char *filename)
+/* handle of open buffer */
+static BufId
+bufId(const Buffer *b)
 {
-	Buffer *buf;
-	int fd;
-	struct stat sb;
-	char *data;
-	String fstr, fline;
-	Line fpush;
+	size_t i = (size_t)((const Slot *)(const void *)b - be.buffers.data);
+	return BUFID(i, be.buffers.data[i].gen);
+}
 
-	pushVector(be.buffers, createBuffer());
-	buf = be.buffers.data + be.buffers.len - 1;
-	strncpy(buf->path, filename, PATH_MAX);
-	strncpy(buf->name, ((strrchr(filename, '/')) == NULL ?
-				filename : (strrchr(filename, '/') + 1)), NAME_MAX);
+/* buffer of handle, NULL if it was closed */
+static Buffer *
+bufGet(BufId id)
+{
+	Slot *sl;
+	if (id == BUFNONE || BUFSLOT(id) >= be.buffers.len)
+		return NULL;
+	sl = be.buffers.data + BUFSLOT(id);
+	return sl->live && BUFID(BUFSLOT(id), sl->gen) == id ? &(sl->b) : NULL;
+}
 
-	buf->anonymous = 0;
+/* next (dir > 0) or previous open buffer, fallback one if none */
+static BufId
+bufStep(BufId id, int dir)
+{
+	size_t i = BUFSLOT(id);
+	Slot *sl = be.buffers.data + i;
+	i = dir > 0 ? sl->next : sl->prev;
+	if (!i && be.buffers.count)
+		i = dir > 0 ? be.buffers.data[0].next : be.buffers.data[0].prev;
+	return BUFID(i, be.buffers.data[i].gen);
+}
 
-	if (stat(filename, &sb) < 0) {
-		errno = 0;
-		pushVector(be.buffers.data[be.buffers.len - 1].lines, newLine(0));
+static void
+bufDel(BufId id)
+{
+	size_t i = BUFSLOT(id), w;
+	Slot *sl;
+	Buffer *b;
+	BufId other;
+	if (!i || !bufGet(id))
 		return;
+	sl = be.buffers.data + i;
+	/* job is stopped, reading standard input ends at once */
+	if (sl->b.job && sl->b.job->pid)
+		kill(-(sl->b.job->pid), SIGTERM);
+	else if (sl->b.job)
+		jobEnd(sl->b.job);
+	if (sl->b.follow)
+		followEnd(sl->b.follow);
+	fileUnwatch(&(sl->b));
+	jnlEnd(&(sl->b));
+	wordsDrop(&(sl->b));
+	other = bufStep(id, 1);
+	if (other == id)
+		other = BUFID(0, be.buffers.data[0].gen);
+	freeBuffer(&(sl->b));
+	be.buffers.data[sl->prev].next = sl->next;
+	be.buffers.data[sl->next].prev = sl->prev;
+	sl->live = 0;
+	++(sl->gen);
+	sl->next = be.buffers.free;
+	be.buffers.free = i;
+	--be.buffers.count;
+	b = &(be.buffers.data[BUFSLOT(other)].b);
+	for (w = 0; w < be.windows.len; ++w) {
+		if (be.windows.data[w].buffer != id)
+			continue;
+		be.windows.data[w].buffer = other;
+		be.windows.data[w].cur = (View){ b->x, b->y, b->xvis, b->xoff };
 	}
+}
 
-	if ((fd = open(filename, O_RDONLY)) < 0)
-		die("open:");
-
-	if (fstat(fd, &sb) < 0)
-		die("stat:");
-
-	/* maybe mmap will be better here? */
-	if (read(fd, fstr.data = data = malloc(((unsigned)sb.st_size * sizeof *data)),
-				fstr.len = (unsigned)sb.st_size) != (unsigned)sb.st_size)
-		die("read:");
-
-	while (Strtok(fstr, &fline, '\n') > 0) {
-		fpush.data = strndup(fline.data, (fpush.len = fline.len - 1));
-		fpush.isMarked = 0;
-		pushVector(buf->lines, fpush);
-		fstr.data += fline.len;
-		fstr.len -= fline.len;
-	}
-
-	free(data);
+static void
+newBuffer(void)
+{
+	Buffer *b = bufGet(bufNew());
+	pushVector(b->lines, newLine(0));
 }
 
 static void
-freeBuffer(Buffer *buf)
+bufferName(Buffer *b, const char *filename)
 {
-	size_t i;
-	for (i = 0; i < buf->lines.len; ++i)
-		free(buf->lines.data[i].data);
+	char *p;
+	free(b->path);
+	b->path = strdup(filename);
+	b->name = (p = strrchr(b->path, '/')) ? p + 1 : b->path;
+	b->anonymous = 0;
+	++(b->drawgen); /* status lines show name */
+	fileWatch(b);
 }
 
+/* reads file into lines and its status into sb, nonexistent file
+   is one empty line with zeroed status; returns -1 with errno set
+   on error */
 static int
-writeBuffer(Buffer *buf, char *filename)
+fileRead(const char *path, Lines *lines, struct stat *sb)
 {
 	int fd;
-	size_t i;
-	if (filename == NULL) {
-		if (buf->anonymous)
-			return minibufferError(lang_err[ErrWriteAnon]);
-		else
-			filename = buf->path;
+	Chunk *c;
+	char *p, *end, *nl;
+	size_t off, n;
+	ssize_t rb;
+
+	newVector(*lines);
+	memset(sb, 0, sizeof *sb);
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		if (errno != ENOENT)
+			return -1;
+		errno = 0;
+		pushVector(*lines, newLine(0));
+		return 0;
+	}
+	if (fstat(fd, sb) < 0 || (S_ISDIR(sb->st_mode) && (errno = EISDIR))) {
+		close(fd);
+		return -1;
 	}
-	if ((fd = open(filename, O_WRONLY | O_CREAT, 0755)) < 0)
-		die("open:");
-	for (i = 0; i < buf->lines.len; ++i) {
-		write(fd, buf->lines.data[i].data, buf->lines.data[i].len);
-		write(fd, "\n", 1);
+	/* big file with index is not read, but mapped */
+	if (indexRead(path, fd, sb, lines) == 0) {
+		close(fd);
+		return 0;
+	}
+
+	/* whole file is one chunk, lines only point into it */
+	c = chunkNew((size_t)sb->st_size);
+	for (off = 0; off < (size_t)sb->st_size; off += (size_t)rb) {
+		if ((rb = read(fd, c->data + off, (size_t)sb->st_size - off)) <= 0) {
+			if (!rb) errno = EIO;
+			free(c);
+			close(fd);
+			return -1;
+		}
 	}
 	close(fd);
-	CURBUF.dirty = 0;
+
+	/* lines are counted first, so their array is allocated once */
+	end = c->data + sb->st_size;
+	for (p = c->data, n = 0; p < end; p = nl + 1, ++n)
+		if ((nl = memchr(p, '\n', (size_t)(end - p))) == NULL)
+			nl = end;
+	lines->data = realloc(lines->data, (n ? n : 1) * sizeof *(lines->data));
+	for (p = c->data; p < end; p = nl + 1) {
+		if ((nl = memchr(p, '\n', (size_t)(end - p))) == NULL)
+			nl = end;
+		lines->data[lines->len++] =
+			(Line){ p, (size_t)(nl - p), c, 0, SYNSTALE, SynNormal };
+		++(c->ref);
+	}
+	if (!c->ref) {
+		free(c);
+		lines->data[lines->len++] = newLine(0);
+	}
+	indexWrite(path, sb, lines);
 	return 0;
 }
 
-static int
-minibufferPrint(const char *s)
+/* line index: lengths of lines of big file are kept in cache directory,
+   so file opened again is not searched for newlines.  Index is
+   INDEXMAGIC, device, inode, size and mtime of file it describes,
+   number of lines and their lengths, all LEB128 numbers */
+static char *
+idxPut(char *p, uint64_t n)
 {
-	String ab = { NULL, 0 };
-	char cp[20];
-
-	abPrintf(&ab, cp, 20, "\033[%4d;%4dH\033[0m\033[K",
-			be.r, 1);
-
-	abAppend(&ab, s, strlen(s));
-
-	abAppend(&ab, "\033[0m", 4);
-
-	if ((unsigned)write(STDOUT_FILENO, ab.data, ab.len) != ab.len)
-		die("write:");
+	do {
+		*p = (char)(n & 0x7f);
+		if (n >>= 7)
+			*p |= (char)0x80;
+		++p;
+	} while (n);
+	return p;
+}
 
-	abFree(&ab);
-	return 0;
+static size_t
+idxHeader(char *p, const struct stat *sb)
+{
+	char *s = p;
+	memcpy(p, INDEXMAGIC, 4);
+	p = idxPut(p + 4, (uint64_t)sb->st_dev);
+	p = idxPut(p, (uint64_t)sb->st_ino);
+	p = idxPut(p, (uint64_t)sb->st_size);
+	p = idxPut(p, (uint64_t)sb->st_mtim.tv_sec);
+	p = idxPut(p, (uint64_t)sb->st_mtim.tv_nsec);
+	return (size_t)(p - s);
 }
 
+/* makes lines of file described by sb, open as fd, from its index;
+   file is mapped and lines point into mapping, so only pages of lines
+   used are ever read.  Index is trusted as far as lengths of lines add
+   up to size of file, newline ending a line is checked by lineCheck
+   when it is used.  Returns -1 if there is no fitting index */
 static int
-minibufferError(const char *s)
+indexRead(const char *path, int fd, const struct stat *sb, Lines *lines)
 {
-	String ab = { NULL, 0 };
+	struct stat isb;
+	char h[INDEXHEADER], *ipath, *idx, *map;
+	const char *p, *end;
+	uint64_t n, len;
+	size_t hlen, i, off, size = (size_t)sb->st_size;
+	Chunk *c;
+	int ifd;
+
+	if (!be.idxdir || be.zero < 0 || !size || size < indexmin
+	|| !S_ISREG(sb->st_mode))
+		return -1;
+	ipath = userFile(be.idxdir, path);
+	ifd = open(ipath, O_RDONLY);
+	free(ipath);
+	if (ifd < 0)
+		return -1;
+	hlen = idxHeader(h, sb);
+	if (fstat(ifd, &isb) < 0 || (size_t)isb.st_size <= hlen
+	|| (idx = mmap(NULL, (size_t)isb.st_size, PROT_READ, MAP_PRIVATE, ifd, 0))
+			== MAP_FAILED) {
+		close(ifd);
+		return -1;
+	}
+	close(ifd);
+	p = idx + hlen;
+	end = idx + isb.st_size;
+	if (memcmp(idx, h, hlen) || jnlGetNum(&p, end, &n) < 0 || !n || n > size
+	|| (map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+		munmap(idx, (size_t)isb.st_size);
+		return -1;
+	}
+	c = chunkNew(sizeof map);
+	memcpy(c->data, &map, sizeof map);
+	c->map = size;
+	lines->data = realloc(lines->data, (size_t)n * sizeof *(lines->data));
+	for (i = 0, off = 0; i < n; ++i, off += (size_t)len + 1) {
+		if (off > size || jnlGetNum(&p, end, &len) < 0 || len > size - off)
+			break;
+		lines->data[i] = (Line){ map + off, (size_t)len, c, 0, SYNSTALE, SynNormal };
+	}
+	munmap(idx, (size_t)isb.st_size);
+	/* only last line may end with end of file */
+	if (i < n || off < size) {
+		chunkFree(c);
+		return -1;
+	}
+	lines->len = i;
+	c->ref = i;
+	return 0;
+}
+
+/* line of file opened through its index, not changed or drawn since
+   (so still of generation 0), must end where file has newline; if it
+   does not, index was wrong and buffer is marked to be read again.
+   Returns -1 then */
+static int
+lineCheck(Buffer *b, size_t y)
+{
+	const Line *l = b->lines.data + y;
+	char *map;
+	if (l->gen || !l->chunk->map)
+		return 0;
+	memcpy(&map, l->chunk->data, sizeof map);
+	if (l->data + l->len == map + l->chunk->map || l->data[l->len] == '\n')
+		return 0;
+	b->idxstale = 1;
+	return -1;
+}
+
+/* checks all lines of buffer, before all of them are used */
+static int
+bufCheck(Buffer *b)
+{
+	size_t y;
+	for (y = 0; y < b->lines.len; ++y)
+		if (lineCheck(b, y) < 0)
+			return -1;
+	return 0;
+}
+
+/* buffers whose lines showed index of their file to be wrong read it
+   again without index, which is made anew; 1 if any was */
+static int
+indexStale(void)
+{
+	Buffer *b;
+	size_t i;
+	char *ipath, msg[PATH_MAX + 64];
+	int any = 0;
+
+	for (i = be.buffers.data[0].next; i; i = be.buffers.data[i].next) {
+		if (!(b = &(be.buffers.data[i].b))->idxstale)
+			continue;
+		b->idxstale = 0;
+		ipath = userFile(be.idxdir, b->path);
+		unlink(ipath);
+		free(ipath);
+		if (fileReload(b) < 0)
+			snprintf(msg, sizeof msg, "%s: %s", b->path, strerror(errno));
+		else
+			snprintf(msg, sizeof msg, lang_err[ErrIndexStale], b->name);
+		minibufferError(msg);
+		any = 1;
+	}
+	return any;
+}
+
+/* stores index of lines of file described by sb, through temporary
+   file, so index is either whole or missing */
+static void
+indexWrite(const char *path, const struct stat *sb, const Lines *lines)
+{
+	char *data, *p, *ipath, *tmp;
+	size_t i;
+	ssize_t len;
+	int fd;
+
+	if (!be.idxdir || !sb->st_size || (size_t)sb->st_size < indexmin)
+		return;
+	/* LEB128 of 64 bits takes 10 bytes at most */
+	p = data = malloc(INDEXHEADER + 10 * (lines->len + 1));
+	p += idxHeader(p, sb);
+	p = idxPut(p, lines->len);
+	for (i = 0; i < lines->len; ++i)
+		p = idxPut(p, lines->data[i].len);
+	len = p - data;
+	ipath = userFile(be.idxdir, path);
+	tmp = malloc(strlen(ipath) + 5);
+	sprintf(tmp, "%s%%new", ipath);
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600)) >= 0) {
+		if (write(fd, data, (size_t)len) != len || close(fd) < 0
+		|| rename(tmp, ipath) < 0)
+			unlink(tmp);
+	}
+	free(tmp);
+	free(ipath);
+	free(data);
+}
+
+/* appends len bytes of chunk to lines, first piece continuing the last
+   line; whole lines point into chunk, which is freed if none does;
+   returns number of lines added */
+static size_t
+chunkAppend(Lines *lines, Chunk *c, size_t len)
+{
+	Line *last = lines->data + lines->len - 1;
+	char *s, *end = c->data + len, *nl;
+	size_t n, i;
+
+	if ((nl = memchr(c->data, '\n', len)) == NULL)
+		nl = end;
+	if (nl > c->data) {
+		lineOwn(last, last->len + (size_t)(nl - c->data));
+		memcpy(last->data + last->len, c->data, (size_t)(nl - c->data));
+		last->len += (size_t)(nl - c->data);
+	}
+	/* lines are counted first, so they are added at once */
+	for (n = 0, s = nl; s < end; ++n)
+		if ((s = memchr(s + 1, '\n', (size_t)(end - s - 1))) == NULL)
+			s = end;
+	if (n) {
+		lines->data = realloc(lines->data, (lines->len + n) * sizeof *(lines->data));
+		for (s = nl + 1, i = 0; i < n; ++i, s = nl + 1) {
+			if ((nl = memchr(s, '\n', (size_t)(end - s))) == NULL)
+				nl = end;
+			lines->data[lines->len++] =
+				(Line){ s, (size_t)(nl - s), c, 0, SYNSTALE, SynNormal };
+			++(c->ref);
+		}
+	}
+	if (!c->ref)
+		free(c);
+	return n;
+}
+
+/* chunk of JOBREAD bytes cut to len bytes read into it, so lines
+   kept from short reads do not hold whole chunks */
+static Chunk *
+chunkShrink(Chunk *c, size_t len)
+{
+	Chunk *n;
+	if (len < JOBREAD && (n = realloc(c, sizeof *c + len)))
+		return n;
+	return c;
+}
+
+/* opens file in new buffer; returns BUFNONE with errno set on error */
+static BufId
+editBuffer(char *filename)
+{
+	Buffer *buf;
+	Lines lines;
+	struct stat sb;
+	BufId id;
+
+	if (fileRead(filename, &lines, &sb) < 0)
+		return BUFNONE;
+	buf = bufGet(id = bufNew());
+	bufferName(buf, filename);
+	free(buf->lines.data);
+	buf->lines = lines;
+	buf->sb = sb;
+	buf->syntax = synDetect(buf);
+	jnlRecover(buf);
+	return id;
+}
+
+/* loading files in background: loader threads take jobs in order
+   and pass finished ones through pipe to main thread, which puts
+   their lines into buffers created for them beforehand */
+static void *
+loaderThread(void *p)
+{
+	Load *l;
+	(void)p;
+	for (;;) {
+		pthread_mutex_lock(&be.loader.lock);
+		l = be.loader.next < be.loader.len ?
+			be.loader.jobs[be.loader.next++] : NULL;
+		pthread_mutex_unlock(&be.loader.lock);
+		if (!l)
+			return NULL;
+		l->err = fileRead(l->path, &(l->lines), &(l->sb)) < 0 ? errno : 0;
+		/* pipe writes this small are atomic */
+		if (write(be.loader.pipe[1], &l, sizeof l) != sizeof l)
+			die("write:");
+	}
+}
+
+static void
+loaderDone(int fd, void *p)
+{
+	Load *l;
+	Buffer *b;
+	size_t i;
+	char msg[PATH_MAX + 64];
+	(void)p;
+
+	while (read(fd, &l, sizeof l) == sizeof l) {
+		++be.loader.done;
+		b = bufGet(l->buf);
+		if (b && l->err) {
+			snprintf(msg, sizeof msg, "%s: %s", l->path, strerror(l->err));
+			minibufferError(msg);
+			/* placeholder is not the file, so it must not be
+			   written over it */
+			fileUnwatch(b);
+			free(b->path);
+			b->path = NULL;
+			b->name = NULL;
+			b->anonymous = 1;
+			++(b->drawgen);
+		} else if (b) {
+			/* placeholder line is replaced by whole file */
+			for (i = 0; i < b->lines.len; ++i)
+				lineFree(b->lines.data + i);
+			free(b->lines.data);
+			b->lines = l->lines;
+			b->sb = l->sb;
+			l->lines.len = 0;
+			b->x = b->y = 0;
+			b->syntax = synDetect(b);
+			bufShift(b, 0, b->lines.len);
+			b->dirty = 0;
+			jnlRecover(b);
+		}
+		if (b)
+			b->load = NULL;
+		/* buffer was closed before its file was read */
+		for (i = 0; i < l->lines.len; ++i)
+			lineFree(l->lines.data + i);
+		if (!b || l->err)
+			free(l->lines.data);
+		free(l);
+	}
+	if (be.loader.done == be.loader.len) {
+		watchDel(fd);
+		close(be.loader.pipe[0]);
+		close(be.loader.pipe[1]);
+		pthread_mutex_lock(&be.loader.lock);
+		free(be.loader.jobs);
+		be.loader.len = be.loader.next = be.loader.done = 0;
+		pthread_mutex_unlock(&be.loader.lock);
+	}
+}
+
+/* creates buffers for files and starts reading them */
+static void
+loaderStart(char **files, size_t n)
+{
+	Buffer *b;
+	pthread_t t;
+	size_t i;
+
+	if (!n) return;
+	if (pipe(be.loader.pipe) < 0)
+		die("pipe:");
+	fcntl(be.loader.pipe[0], F_SETFL, O_NONBLOCK);
+	pthread_mutex_init(&be.loader.lock, NULL);
+	be.loader.jobs = malloc(n * sizeof *(be.loader.jobs));
+	be.loader.len = n;
+	be.loader.next = be.loader.done = 0;
+	for (i = 0; i < n; ++i) {
+		be.loader.jobs[i] = calloc(1, sizeof **(be.loader.jobs));
+		be.loader.jobs[i]->path = files[i];
+		b = bufGet(be.loader.jobs[i]->buf = bufNew());
+		bufferName(b, files[i]);
+		pushVector(b->lines, newLine(0));
+		b->load = be.loader.jobs[i];
+	}
+	watchAdd(be.loader.pipe[0], loaderDone, NULL);
+	for (i = 0; i < UMIN(loadthreads, n); ++i) {
+		if (pthread_create(&t, NULL, loaderThread, NULL))
+			die("pthread_create:");
+		pthread_detach(t);
+	}
+}
+
+/* directory of path, to be freed */
+static char *
+pathDir(const char *path)
+{
+	char *dir = strdup(path), *s;
+	if ((s = strrchr(dir, '/')))
+		s[s == dir] = '\0';
+	else
+		strcpy(dir, ".");
+	return dir;
+}
+
+/* file changed since sb was taken; file which did not exist then
+   changed if it exists now */
+static int
+fileChanged(const char *path, const struct stat *sb)
+{
+	struct stat now;
+	if (stat(path, &now) < 0)
+		return 0;
+	return now.st_dev != sb->st_dev || now.st_ino != sb->st_ino
+		|| now.st_size != sb->st_size
+		|| now.st_mtim.tv_sec != sb->st_mtim.tv_sec
+		|| now.st_mtim.tv_nsec != sb->st_mtim.tv_nsec;
+}
+
+/* directory of file of buffer is watched rather than the file itself,
+   so file replaced by rename is noticed too */
+static void
+fileWatch(Buffer *b)
+{
+#ifdef __linux__
+	char *dir;
+	if (be.inotify < 0)
+		return;
+	dir = pathDir(b->path);
+	b->wd = inotify_add_watch(be.inotify, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+	free(dir);
+#else
+	(void)b;
+#endif
+}
+
+/* watch is shared by buffers of files in one directory */
+static void
+fileUnwatch(Buffer *b)
+{
+	size_t i;
+	if (b->wd < 0)
+		return;
+	for (i = be.buffers.data[0].next; i; i = be.buffers.data[i].next)
+		if (&(be.buffers.data[i].b) != b && be.buffers.data[i].b.wd == b->wd)
+			break;
+#ifdef __linux__
+	if (!i)
+		inotify_rm_watch(be.inotify, b->wd);
+#endif
+	b->wd = -1;
+}
+
+static void
+fileEvents(int fd, void *p)
+{
+#ifdef __linux__
+	union { struct inotify_event e; char s[4096]; } ev;
+	const struct inotify_event *e;
+	ssize_t rb, off;
+	size_t i;
+	Buffer *b;
+	(void)p;
+
+	while ((rb = read(fd, &ev, sizeof ev)) > 0) {
+		for (off = 0; off < rb; off += (ssize_t)(sizeof *e + e->len)) {
+			e = (const struct inotify_event *)(ev.s + off);
+			if (!e->len)
+				continue;
+			for (i = be.buffers.data[0].next; i; i = be.buffers.data[i].next) {
+				b = &(be.buffers.data[i].b);
+				if (b->wd == e->wd && !strcmp(b->name, e->name))
+					fileCheck(BUFID(i, be.buffers.data[i].gen));
+			}
+		}
+	}
+#else
+	(void)fd;
+	(void)p;
+#endif
+}
+
+/* file of buffer was written by someone else: buffer without changes
+   is reloaded, user is asked what to do with the one with changes and
+   the next key typed answers, see editorGetKey; buffer kept is stale,
+   so it is not asked again and :w does not overwrite file unless forced */
+static void
+fileCheck(BufId id)
+{
+	Buffer *b = bufGet(id);
+	char msg[PATH_MAX + 64];
+
+	if (!b || b->anonymous || b->load || b->job || b->follow || b->stale
+	||  !fileChanged(b->path, &(b->sb)))
+		return;
+	if (b->dirty && be.reload == BUFNONE) {
+		be.reload = id;
+		snprintf(msg, sizeof msg, lang_info[InfoReloadAsk], b->name);
+		minibufferPrint(msg);
+	}
+	if (!b->dirty)
+		fileUpdate(b);
+}
+
+/* reloads buffer, telling how it went */
+static void
+fileUpdate(Buffer *b)
+{
+	char msg[PATH_MAX + 64];
+
+	if (fileReload(b) < 0) {
+		snprintf(msg, sizeof msg, "%s: %s", b->path, strerror(errno));
+		minibufferError(msg);
+		return;
+	}
+	snprintf(msg, sizeof msg, lang_info[InfoReloaded], b->name);
+	minibufferPrint(msg);
+}
+
+/* answer to question of fileCheck; buffers whose files changed while
+   it was asked are checked again, so they are asked about next */
+static void
+fileAnswer(int yes)
+{
+	Buffer *b = bufGet(be.reload);
+	size_t i;
+
+	be.reload = BUFNONE;
+	minibufferPrint("");
+	if (b && yes)
+		fileUpdate(b);
+	else if (b)
+		b->stale = 1;
+	for (i = be.buffers.data[0].next; i; i = be.buffers.data[i].next)
+		fileCheck(BUFID(i, be.buffers.data[i].gen));
+}
+
+static uint64_t
+fnv(const char *s, size_t n)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	size_t i;
+	for (i = 0; i < n; ++i)
+		h = (h ^ (unsigned char)s[i]) * 0x100000001b3ULL;
+	return h;
+}
+
+static inline uint64_t
+lineHash(const Line *l)
+{
+	return fnv(l->data, l->len);
+}
+
+static inline int
+lineEq(const Line *a, const Line *b)
+{
+	return a->len == b->len && !memcmp(a->data, b->data, a->len);
+}
+
+/* entry of line text in table of linesMatch */
+static LineMatch *
+lineMatchGet(LineMatch *t, size_t mask, const Line *l)
+{
+	uint64_t h = lineHash(l);
+	size_t i;
+	for (i = (size_t)h & mask; t[i].l; i = (i + 1) & mask)
+		if (t[i].hash == h && lineEq(t[i].l, l))
+			return t + i;
+	t[i].l = l;
+	t[i].hash = h;
+	return t + i;
+}
+
+/* matches lines of nw to equal lines of old, keeping their order: common
+   first and last lines, then lines occurring once in what is left of
+   both, longest run of them which is in order, and lines around them
+   while they are equal; map gets index in old of each line of nw,
+   -1 for lines which are new */
+static void
+linesMatch(const Lines *old, const Lines *nw, ssize_t *map)
+{
+	size_t pre, suf, n, m, i, j, k, len, mask, *cand, *tails, *prev;
+	char *used;
+	LineMatch *t, *e;
+
+	for (i = 0; i < nw->len; ++i)
+		map[i] = -1;
+	for (pre = 0; pre < old->len && pre < nw->len
+			&& lineEq(old->data + pre, nw->data + pre); ++pre)
+		map[pre] = (ssize_t)pre;
+	for (suf = 0; suf < old->len - pre && suf < nw->len - pre
+			&& lineEq(old->data + old->len - 1 - suf,
+			          nw->data + nw->len - 1 - suf); ++suf)
+		map[nw->len - 1 - suf] = (ssize_t)(old->len - 1 - suf);
+	n = old->len - pre - suf;
+	m = nw->len - pre - suf;
+	if (!n || !m)
+		return;
+
+	for (mask = 1; mask < 2 * (n + m); mask <<= 1);
+	t = calloc(mask--, sizeof *t);
+	for (i = pre; i < pre + n; ++i) {
+		e = lineMatchGet(t, mask, old->data + i);
+		++(e->na);
+		e->a = i;
+	}
+	for (j = pre; j < pre + m; ++j)
+		++(lineMatchGet(t, mask, nw->data + j)->nb);
+
+	/* lines unique in both, in order of nw; longest run of them
+	   increasing in old is found by patience sorting */
+	cand = malloc(m * sizeof *cand);
+	tails = malloc(m * sizeof *tails);
+	prev = malloc(m * sizeof *prev);
+	for (j = pre, len = 0; j < pre + m; ++j) {
+		e = lineMatchGet(t, mask, nw->data + j);
+		if (e->na != 1 || e->nb != 1)
+			continue;
+		cand[j - pre] = e->a;
+		for (i = 0, k = len; i < k; ) {
+			if (cand[tails[(i + k) / 2] - pre] < e->a)
+				i = (i + k) / 2 + 1;
+			else
+				k = (i + k) / 2;
+		}
+		prev[j - pre] = i ? tails[i - 1] : SIZE_MAX;
+		tails[i] = j;
+		if (i == len)
+			++len;
+	}
+	for (j = len ? tails[len - 1] : SIZE_MAX; j != SIZE_MAX; j = prev[j - pre])
+		map[j] = (ssize_t)cand[j - pre];
+
+	/* runs of equal lines are grown forward and back from them */
+	used = calloc(old->len, 1);
+	for (j = 0; j < nw->len; ++j)
+		if (map[j] >= 0)
+			used[map[j]] = 1;
+	for (j = pre; j + 1 < pre + m; ++j)
+		if (map[j] >= 0 && map[j + 1] < 0 && (size_t)map[j] + 1 < old->len
+		&&  !used[map[j] + 1] && lineEq(old->data + map[j] + 1, nw->data + j + 1))
+			used[map[j + 1] = map[j] + 1] = 1;
+	for (j = pre + m - 1; j > pre; --j)
+		if (map[j] > 0 && map[j - 1] < 0
+		&&  !used[map[j] - 1] && lineEq(old->data + map[j] - 1, nw->data + j - 1))
+			used[map[j - 1] = map[j] - 1] = 1;
+
+	free(used);
+	free(prev);
+	free(tails);
+	free(cand);
+	free(t);
+}
+
+/* line of nw where line y of old went, or the next one which is kept */
+static ssize_t
+lineMoved(const ssize_t *inv, size_t oldlen, size_t newlen, ssize_t y)
+{
+	for (; y >= 0 && (size_t)y < oldlen; ++y)
+		if (inv[y] >= 0)
+			return inv[y];
+	return (ssize_t)newlen - 1;
+}
+
+/* reads file of buffer again; lines which did not change are kept with
+   their storage, marks and lexer state, so only changed ones are drawn
+   and lexed again */
+static int
+fileReload(Buffer *b)
+{
+	Lines nw, old = b->lines;
+	unsigned long *marks = b->marks.data;
+	size_t nmarks = b->marks.len;
+	struct stat sb;
+	ssize_t *map, *inv;
+	size_t i, j, first;
+	Window *w;
+	int inplace;
+
+	if (fileRead(b->path, &nw, &sb) < 0)
+		return -1;
+	map = malloc(nw.len * sizeof *map);
+	inv = malloc(old.len * sizeof *inv);
+	linesMatch(&old, &nw, map);
+	for (i = 0; i < old.len; ++i)
+		inv[i] = -1;
+	first = SIZE_MAX;
+	inplace = old.len == nw.len;
+	for (j = 0; j < nw.len; ++j) {
+		if (map[j] >= 0) {
+			inv[map[j]] = (ssize_t)j;
+			lineFree(nw.data + j);
+			nw.data[j] = old.data[map[j]];
+		}
+		if (map[j] != (ssize_t)j && first == SIZE_MAX)
+			first = j;
+		if (map[j] >= 0 && map[j] != (ssize_t)j)
+			inplace = 0;
+	}
+	for (i = 0; i < old.len; ++i)
+		if (inv[i] < 0)
+			lineFree(old.data + i);
+	b->lines = nw;
+	b->sb = sb;
+
+	newVector(b->marks);
+	for (i = 0; i < old.len; ++i)
+		if (inv[i] >= 0 && i / MARKBITS < nmarks
+		&&  (marks[i / MARKBITS] >> (i % MARKBITS) & 1))
+			markToggle(b, (size_t)inv[i]);
+	free(marks);
+
+	/* lines changed in place are drawn again, shifted ones from
+	   the first of them on */
+	if (inplace) {
+		for (j = 0; j < nw.len; ++j)
+			if (map[j] < 0)
+				bufTouch(b, j);
+	} else {
+		/* lines at end found at the end of old ones are only shifted */
+		for (j = nw.len; j > first && map[j - 1] >= 0
+				&& (size_t)map[j - 1] + nw.len == j - 1 + old.len; --j);
+		bufShift(b, first < nw.len ? first : nw.len, j);
+	}
+	b->dirty = b->stale = 0;
+	jnlEnd(b);
+
+	b->y = lineMoved(inv, old.len, nw.len, b->y);
+	if (b->x > (ssize_t)b->lines.data[b->y].len)
+		b->x = (ssize_t)b->lines.data[b->y].len;
+	for (w = be.windows.data; w < be.windows.data + be.windows.len; ++w)
+		if (&(be.buffers.data[BUFSLOT(w->buffer)].b) == b)
+			w->cur.y = lineMoved(inv, old.len, nw.len, w->cur.y);
+	free(inv);
+	free(map);
+	free(old.data);
+	return 0;
+}
+
+/* journals: changes of buffers are appended as records to their journal
+   files, which are synced when user stops typing and removed when buffer
+   is written or closed; journal left by crashed editor is replayed when
+   its file is opened again.  Journal is locked by the buffer writing
+   it; buffers editing the same file at once take the next of JOURNALS
+   names.  Journal starts with JOURNALMAGIC, pid of its
+   editor and status of file it is based on, then records follow:
+   'i' y x n bytes    n bytes inserted into line y before x
+   'd' y x1 x2        bytes [x1, x2) of line y deleted
+   'L' y n bytes      line y replaced
+   'I' at n lines     n lines inserted before line at, each as n bytes
+   'D' at n           n lines deleted from line at on
+   'P' at n order     lines [at, at + n) reordered, i-th of them is
+                      the order[i]-th of them before
+   'C' at y n times   times copies of lines [y, y + n) inserted before
+                      line at
+   numbers are unsigned LEB128; records with long text are written
+   straight from lines, others gathered in memory until next flush */
+
+/* directory be keeps its files in under directory of XDG variable
+   var, or under fallback in home; it is created if needed, NULL if
+   there is no home */
+static char *
+userDir(const char *var, const char *fallback)
+{
+	const char *base = getenv(var), *home = getenv("HOME");
+	char *dir, *s;
+	size_t len;
+
+	if (base && *base == '/') {
+		len = strlen(base) + 4;
+		snprintf(dir = malloc(len), len, "%s/be", base);
+	} else if (home && *home) {
+		len = strlen(home) + strlen(fallback) + 5;
+		snprintf(dir = malloc(len), len, "%s/%s/be", home, fallback);
+	} else {
+		return NULL;
+	}
+	for (s = dir + 1; (s = strchr(s, '/')); ++s) {
+		*s = '\0';
+		mkdir(dir, 0700);
+		*s = '/';
+	}
+	if (mkdir(dir, 0700) < 0 && errno != EEXIST) {
+		free(dir);
+		return NULL;
+	}
+	return dir;
+}
+
+/* file in dir named after absolute path of file, with slashes made
+   percent signs; too long name is its hash */
+static char *
+userFile(const char *dir, const char *path)
+{
+	char cwd[PATH_MAX], *abs, *f, *s;
+	size_t len;
+
+	if (*path == '/' || !getcwd(cwd, sizeof cwd))
+		*cwd = '\0';
+	len = strlen(cwd) + strlen(path) + 2;
+	abs = malloc(len);
+	snprintf(abs, len, *cwd ? "%s/%s" : "%s%s", cwd, path);
+	for (s = abs; (s = strchr(s, '/')); *s = '%');
+	len = strlen(dir) + strlen(abs) + 2;
+	f = malloc(len > strlen(dir) + 18 ? len : strlen(dir) + 18);
+	if (strlen(abs) > NAME_MAX - 8)
+		sprintf(f, "%s/%016llx", dir, (unsigned long long)fnv(abs, strlen(abs)));
+	else
+		sprintf(f, "%s/%s", dir, abs);
+	free(abs);
+	return f;
+}
+
+static void
+jnlNum(String *s, uint64_t n)
+{
+	char c;
+	do {
+		c = (char)(n & 0x7f);
+		if (n >>= 7)
+			c |= (char)0x80;
+		abAppend(s, &c, 1);
+	} while (n);
+}
+
+/* number at *p, moving p past it; -1 if it does not end before end */
+static int
+jnlGetNum(const char **p, const char *end, uint64_t *n)
+{
+	unsigned int sh;
+	for (*n = 0, sh = 0; *p < end && sh < 64; sh += 7) {
+		*n |= (uint64_t)(**p & 0x7f) << sh;
+		if (!(*((*p)++) & 0x80))
+			return 0;
+	}
+	return -1;
+}
+
+static void
+jnlHeader(String *s, pid_t pid, const struct stat *sb)
+{
+	abAppend(s, JOURNALMAGIC, 4);
+	jnlNum(s, (uint64_t)pid);
+	jnlNum(s, (uint64_t)sb->st_dev);
+	jnlNum(s, (uint64_t)sb->st_ino);
+	jnlNum(s, (uint64_t)sb->st_size);
+	jnlNum(s, (uint64_t)sb->st_mtim.tv_sec);
+	jnlNum(s, (uint64_t)sb->st_mtim.tv_nsec);
+}
+
+/* name of journal i of file of buffer */
+static char *
+jnlPath(const Buffer *b, int i)
+{
+	char *f = userFile(be.jnldir, b->path), *p;
+	if (!i)
+		return f;
+	p = malloc(strlen(f) + 8);
+	sprintf(p, "%s%%%d", f, i);
+	free(f);
+	return p;
+}
+
+/* opens journal locked, so no other buffer or editor writes it;
+   -1 if it cannot be opened or is locked */
+static int
+jnlOpen(const char *path, int flags)
+{
+	int fd;
+	if ((fd = open(path, flags | O_CLOEXEC, 0600)) < 0)
+		return -1;
+	if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* journal records of buffer go to, opened with first change;
+   NULL if buffer is not journaled */
+static Journal *
+jnlGet(Buffer *b)
+{
+	Journal *j;
+	int i;
+	if (b->jnl)
+		return b->jnl->fd >= 0 ? b->jnl : NULL;
+	if (!be.jnldir || be.recovering || b->anonymous || b->load || b->job)
+		return NULL;
+	j = b->jnl = malloc(sizeof *j);
+	j->rec.data = NULL;
+	j->rec.len = 0;
+	j->unsynced = 0;
+	/* first name not locked by another buffer; it is truncated only
+	   once locked */
+	for (i = 0, j->fd = -1; i < JOURNALS && j->fd < 0; ++i) {
+		j->path = jnlPath(b, i);
+		if ((j->fd = jnlOpen(j->path, O_WRONLY | O_CREAT)) >= 0
+		&&  ftruncate(j->fd, 0) < 0) {
+			close(j->fd);
+			j->fd = -1;
+		}
+		if (j->fd < 0)
+			free(j->path);
+	}
+	if (j->fd < 0) {
+		j->path = NULL;
+		return NULL;
+	}
+	jnlHeader(&(j->rec), getpid(), &(b->sb));
+	return j;
+}
+
+/* ends record begun in h with n bytes of s; long text is written
+   straight from s with it, short one gathered with other records */
+static void
+jnlText(Buffer *b, String *h, const char *s, size_t n)
+{
+	struct iovec iov[2];
+	if (n < JOURNALDIRECT) {
+		abAppend(&(b->jnl->rec), h->data, h->len);
+		abAppend(&(b->jnl->rec), s, n);
+	} else {
+		iov[0] = (struct iovec){ h->data, h->len };
+		iov[1] = (struct iovec){ (char *)s, n };
+		jnlDirect(b, iov, 2);
+	}
+	abFree(h);
+}
+
+static void
+jnlChars(Buffer *b, size_t y, size_t x, const char *s, size_t n)
+{
+	String h = { NULL, 0 };
+	if (!jnlGet(b))
+		return;
+	abAppend(&h, "i", 1);
+	jnlNum(&h, y);
+	jnlNum(&h, x);
+	jnlNum(&h, n);
+	jnlText(b, &h, s, n);
+}
+
+static void
+jnlCut(Buffer *b, size_t y, size_t x1, size_t x2)
+{
+	Journal *j;
+	if (!(j = jnlGet(b)))
+		return;
+	abAppend(&(j->rec), "d", 1);
+	jnlNum(&(j->rec), y);
+	jnlNum(&(j->rec), x1);
+	jnlNum(&(j->rec), x2);
+}
+
+static void
+jnlLine(Buffer *b, size_t y)
+{
+	String h = { NULL, 0 };
+	if (!jnlGet(b))
+		return;
+	abAppend(&h, "L", 1);
+	jnlNum(&h, y);
+	jnlNum(&h, b->lines.data[y].len);
+	jnlText(b, &h, b->lines.data[y].data, b->lines.data[y].len);
+}
+
+/* lines [at, at + n) were inserted */
+static void
+jnlLines(Buffer *b, size_t at, size_t n)
+{
+	Journal *j;
+	struct iovec iov[WRITEIOV];
+	String h = { NULL, 0 };
+	size_t i, e, k, len, pos[WRITEIOV / 2];
+	int m;
+	if (!(j = jnlGet(b)))
+		return;
+	for (i = at, len = 0; i < at + n && len < JOURNALDIRECT; ++i)
+		len += b->lines.data[i].len;
+	if (len < JOURNALDIRECT) {
+		abAppend(&(j->rec), "I", 1);
+		jnlNum(&(j->rec), at);
+		jnlNum(&(j->rec), n);
+		for (i = at; i < at + n; ++i) {
+			jnlNum(&(j->rec), b->lines.data[i].len);
+			abAppend(&(j->rec), b->lines.data[i].data, b->lines.data[i].len);
+		}
+		return;
+	}
+	/* lengths of a batch of lines are encoded first, as h moves while
+	   it grows, then written between lines; the first one goes with
+	   head of record */
+	abAppend(&h, "I", 1);
+	jnlNum(&h, at);
+	jnlNum(&h, n);
+	for (i = at; i < at + n; i = e) {
+		e = at + n - i < WRITEIOV / 2 ? at + n : i + WRITEIOV / 2;
+		for (k = i; k < e; ++k) {
+			pos[k - i] = k == i ? 0 : h.len;
+			jnlNum(&h, b->lines.data[k].len);
+		}
+		for (k = i, m = 0; k < e; ++k) {
+			iov[m++] = (struct iovec){ h.data + pos[k - i],
+				(k + 1 < e ? pos[k + 1 - i] : h.len) - pos[k - i] };
+			iov[m++] = (struct iovec){ b->lines.data[k].data, b->lines.data[k].len };
+		}
+		if (jnlDirect(b, iov, m) < 0)
+			break;
+		h.len = 0;
+	}
+	abFree(&h);
+}
+
+static void
+jnlDelete(Buffer *b, size_t at, size_t n)
+{
+	Journal *j;
+	if (!(j = jnlGet(b)))
+		return;
+	abAppend(&(j->rec), "D", 1);
+	jnlNum(&(j->rec), at);
+	jnlNum(&(j->rec), n);
+}
+
+/* lines [at, at + n) were reordered, i-th of them is the order[i]-th
+   of them before */
+static void
+jnlOrder(Buffer *b, size_t at, size_t n, const size_t *order)
+{
+	Journal *j;
+	size_t i;
+	if (!(j = jnlGet(b)))
+		return;
+	abAppend(&(j->rec), "P", 1);
+	jnlNum(&(j->rec), at);
+	jnlNum(&(j->rec), n);
+	for (i = 0; i < n; ++i)
+		jnlNum(&(j->rec), order[i]);
+}
+
+/* times copies of lines [y, y + n) were inserted before line at,
+   y counted before they were */
+static void
+jnlCopy(Buffer *b, size_t at, size_t y, size_t n, size_t times)
+{
+	Journal *j;
+	if (!(j = jnlGet(b)))
+		return;
+	abAppend(&(j->rec), "C", 1);
+	jnlNum(&(j->rec), at);
+	jnlNum(&(j->rec), y);
+	jnlNum(&(j->rec), n);
+	jnlNum(&(j->rec), times);
+}
+
+/* writes records gathered for buffer to its journal; -1 on error */
+static int
+jnlPut(Buffer *b)
+{
+	Journal *j = b->jnl;
+	struct iovec iov;
+	if (!j->rec.len)
+		return 0;
+	iov = (struct iovec){ j->rec.data, j->rec.len };
+	if (writevAll(j->fd, &iov, 1) < 0)
+		return -1;
+	abFree(&(j->rec));
+	j->rec.data = NULL;
+	j->rec.len = 0;
+	j->unsynced = be.unsynced = 1;
+	return 0;
+}
+
+/* writes gathered records, then n pieces of a record straight to
+   journal; -1 if journaling of buffer had to stop */
+static int
+jnlDirect(Buffer *b, struct iovec *iov, int n)
+{
+	if (jnlPut(b) < 0 || writevAll(b->jnl->fd, iov, n) < 0) {
+		jnlFail(b);
+		return -1;
+	}
+	return 0;
+}
+
+/* journal which cannot be written misses changes, so it is removed
+   and buffer is not journaled any more; user is told why */
+static void
+jnlFail(Buffer *b)
+{
+	char msg[PATH_MAX + 128];
+	snprintf(msg, sizeof msg, lang_err[ErrJnlWrite], b->name, strerror(errno));
+	unlink(b->jnl->path);
+	close(b->jnl->fd);
+	b->jnl->fd = -1;
+	abFree(&(b->jnl->rec));
+	b->jnl->rec.data = NULL;
+	b->jnl->rec.len = 0;
+	minibufferError(msg);
+}
+
+/* writes records of all buffers to their journals; once user is idle,
+   they are synced too */
+static void
+jnlFlush(int sync)
+{
+	size_t i;
+	Journal *j;
+	for (i = be.buffers.data[0].next; i; i = be.buffers.data[i].next) {
+		if (!(j = be.buffers.data[i].b.jnl) || j->fd < 0)
+			continue;
+		if (jnlPut(&(be.buffers.data[i].b)) < 0) {
+			jnlFail(&(be.buffers.data[i].b));
+			continue;
+		}
+		if (sync && j->unsynced) {
+			fdatasync(j->fd);
+			j->unsynced = 0;
+		}
+	}
+	if (sync)
+		be.unsynced = 0;
+}
+
+/* buffer has no changes to keep any more, or was closed */
+static void
+jnlEnd(Buffer *b)
+{
+	if (!b->jnl)
+		return;
+	/* removed while still locked, so no one starts writing it */
+	if (b->jnl->fd >= 0) {
+		unlink(b->jnl->path);
+		close(b->jnl->fd);
+	}
+	free(b->jnl->path);
+	abFree(&(b->jnl->rec));
+	free(b->jnl);
+	b->jnl = NULL;
+}
+
+/* applies records of journal between *pp and end to buffer, returns
+   number of them; replay stops at record cut short by crash */
+static size_t
+jnlReplay(Buffer *b, const char **pp, const char *end)
+{
+	uint64_t a[4], n, i;
+	const char *p = *pp, *r;
+	size_t done;
+	Line *l;
+	char t, *seen;
+
+	/* pp is left at the first record not replayed */
+	for (done = 0; (*pp = p) < end; ++done) {
+		t = *p++;
+		if (jnlGetNum(&p, end, a) < 0 || jnlGetNum(&p, end, a + 1) < 0
+		||  (t != 'D' && t != 'I' && t != 'L' && t != 'P' && jnlGetNum(&p, end, a + 2) < 0)
+		||  (t == 'C' && jnlGetNum(&p, end, a + 3) < 0))
+			break;
+		if (t == 'i' && a[0] < b->lines.len && a[1] <= b->lines.data[a[0]].len
+		&&  a[2] <= (uint64_t)(end - p)) {
+			charsInsert(b, a[0], a[1], p, a[2]);
+			p += a[2];
+		} else if (t == 'd' && a[0] < b->lines.len) {
+			charsDelete(b, a[0], a[1], a[2]);
+		} else if (t == 'L' && a[0] < b->lines.len && a[1] <= (uint64_t)(end - p)) {
+			lineFree(b->lines.data + a[0]);
+			b->lines.data[a[0]] = lineDup(p, a[1]);
+			bufTouch(b, a[0]);
+			p += a[1];
+		} else if (t == 'I' && a[0] <= b->lines.len) {
+			/* lines are checked before any is inserted */
+			for (r = p, i = 0; i < a[1]; ++i, r += n)
+				if (jnlGetNum(&r, end, &n) < 0 || n > (uint64_t)(end - r))
+					return done;
+			l = linesInsert(b, a[0], a[1]);
+			for (i = 0; i < a[1]; ++i, p += n) {
+				jnlGetNum(&p, end, &n);
+				l[i] = lineDup(p, n);
+			}
+		} else if (t == 'D' && a[0] < b->lines.len && a[1] <= b->lines.len - a[0]) {
+			linesDelete(b, a[0], a[1]);
+		} else if (t == 'P' && a[0] <= b->lines.len && a[1] <= b->lines.len - a[0]) {
+			/* order must be a permutation of the lines */
+			seen = calloc(a[1] ? a[1] : 1, 1);
+			for (r = p, i = 0; i < a[1]; ++i)
+				if (jnlGetNum(&r, end, &n) < 0 || n >= a[1] || seen[n]++)
+					break;
+			free(seen);
+			if (i < a[1])
+				break;
+			l = malloc((a[1] ? a[1] : 1) * sizeof *l);
+			for (i = 0; i < a[1]; ++i) {
+				jnlGetNum(&p, end, &n);
+				l[i] = b->lines.data[a[0] + n];
+			}
+			memcpy(b->lines.data + a[0], l, a[1] * sizeof *l);
+			free(l);
+			bufShift(b, a[0], a[0] + a[1]);
+		} else if (t == 'C' && a[0] <= b->lines.len && a[1] <= b->lines.len
+		&&  a[2] <= b->lines.len - a[1]) {
+			/* copied lines are taken before any is inserted */
+			l = malloc((a[2] ? a[2] : 1) * sizeof *l);
+			memcpy(l, b->lines.data + a[1], a[2] * sizeof *l);
+			linesCopy(b, a[0], l, a[2], a[3]);
+			free(l);
+		} else {
+			break;
+		}
+	}
+	return done;
+}
+
+/* replays journal left for file of buffer by editor which did not
+   finish; journal locked by running editor is left alone, the one of
+   file which changed since is moved aside */
+static void
+jnlRecover(Buffer *b)
+{
+	String s, h;
+	struct stat sb;
+	char *path, *data, msg[2 * PATH_MAX + 64], *tmp;
+	const char *p, *r, *end;
+	uint64_t pid;
+	size_t n;
+	int i, fd, nfd, locked;
+
+	if (!be.jnldir || b->anonymous)
+		return;
+	/* the first journal not locked by anyone else is replayed */
+	for (i = 0; i < JOURNALS && !b->jnl; ++i) {
+		path = jnlPath(b, i);
+		if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+			free(path);
+			continue;
+		}
+		/* journal is read once it is locked, so it is complete */
+		locked = !flock(fd, LOCK_EX | LOCK_NB);
+		if (fstat(fd, &sb) < 0)
+			sb.st_size = 0;
+		data = malloc((size_t)sb.st_size + 1);
+		n = read(fd, data, (size_t)sb.st_size) == sb.st_size ? (size_t)sb.st_size : 0;
+		p = data + 4;
+		end = data + n;
+		if (n < 4 || memcmp(data, JOURNALMAGIC, 4) || jnlGetNum(&p, end, &pid) < 0) {
+			close(fd);
+			free(data);
+			free(path);
+			continue;
+		}
+		if (!locked) {
+			/* other buffer of this editor writes it, or other editor */
+			if ((pid_t)pid != getpid()) {
+				snprintf(msg, sizeof msg, lang_err[ErrJnlBusy], b->name, (long)pid);
+				minibufferError(msg);
+			}
+			close(fd);
+			free(data);
+			free(path);
+			continue;
+		}
+		/* header of journal must be the one this file would have */
+		s.data = h.data = NULL;
+		s.len = h.len = 0;
+		jnlHeader(&h, (pid_t)pid, &(b->sb));
+		tmp = malloc(strlen(path) + 5);
+		if (h.len > n || memcmp(h.data, data, h.len)) {
+			/* it cannot be replayed, but it is not thrown away */
+			sprintf(tmp, "%s%%old", path);
+			rename(path, tmp);
+			snprintf(msg, sizeof msg, lang_err[ErrJnlStale], b->name, tmp);
+			minibufferError(msg);
+			free(path);
+		} else {
+			b->jnl = malloc(sizeof *(b->jnl));
+			b->jnl->fd = -1;
+			b->jnl->path = path;
+			b->jnl->rec = s;
+			b->jnl->unsynced = 0;
+			be.recovering = 1;
+			r = data + h.len;
+			n = jnlReplay(b, &r, end);
+			be.recovering = 0;
+			/* journal goes on as this editor's one, with records
+			   which were replayed only; new one is locked before
+			   it replaces old one */
+			jnlHeader(&s, getpid(), &(b->sb));
+			abAppend(&s, data + h.len, (size_t)(r - data) - h.len);
+			sprintf(tmp, "%s%%new", path);
+			if ((nfd = jnlOpen(tmp, O_WRONLY | O_CREAT | O_TRUNC)) >= 0
+			&&  write(nfd, s.data, s.len) == (ssize_t)s.len && !fsync(nfd)
+			&&  !rename(tmp, path))
+				b->jnl->fd = nfd;
+			else if (nfd >= 0)
+				close(nfd);
+			abFree(&s);
+			if (n) {
+				snprintf(msg, sizeof msg, lang_info[InfoRecovered],
+						b->name, (unsigned long)n);
+				minibufferPrint(msg);
+			}
+		}
+		close(fd);
+		free(tmp);
+		abFree(&h);
+		free(data);
+	}
+}
+
+/* watches */
+static void
+watchAdd(int fd, void (*func)(int, void *), void *p)
+{
+	pushVector(be.watches, ((Watch){ fd, func, p }));
+}
+
+static void
+watchDel(int fd)
+{
+	size_t i;
+	for (i = 0; i < be.watches.len; ++i) {
+		if (be.watches.data[i].fd == fd) {
+			memmove(be.watches.data + i, be.watches.data + i + 1,
+					(--be.watches.len - i) * sizeof *(be.watches.data));
+			return;
+		}
+	}
+}
+
+/* jobs: commands run with :sh! and standard input read with "be -"
+   write into buffer through pipe watched like other descriptors,
+   so editing goes on meanwhile */
+static BufId
+jobOpen(Job *j, char *path)
+{
+	Buffer *b;
+	BufId id;
+	fcntl(j->fd, F_SETFL, O_NONBLOCK);
+	fcntl(j->fd, F_SETFD, FD_CLOEXEC);
+	b = bufGet(id = bufNew());
+	pushVector(b->lines, newLine(0));
+	b->path = path;
+	b->name = b->path;
+	b->job = j;
+	j->buf = id;
+	watchAdd(j->fd, jobRead, j);
+	return id;
+}
+
+static void
+jobStart(const char *cmd, size_t len)
+{
+	int fds[2], dn;
+	pid_t pid;
+	Job *j;
+	BufId id;
+	char *path;
+	size_t w = (size_t)be.focusedwin;
+
+	if (pipe(fds) < 0) {
+		minibufferError(strerror(errno));
+		return;
+	}
+	j = malloc(sizeof *j);
+	j->cmd = malloc(len + 1);
+	memcpy(j->cmd, cmd, len);
+	j->cmd[len] = '\0';
+	if ((pid = fork()) < 0) {
+		minibufferError(strerror(errno));
+		close(fds[0]);
+		close(fds[1]);
+		free(j->cmd);
+		free(j);
+		return;
+	}
+	if (!pid) {
+		/* own process group, so closing buffer stops whole pipeline */
+		setpgid(0, 0);
+		signal(SIGPIPE, SIG_DFL);
+		if ((dn = open("/dev/null", O_RDONLY)) >= 0)
+			dup2(dn, STDIN_FILENO);
+		dup2(fds[1], STDOUT_FILENO);
+		dup2(fds[1], STDERR_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		execl("/bin/sh", "sh", "-c", j->cmd, (char *)NULL);
+		_exit(127);
+	}
+	close(fds[1]);
+	j->pid = pid;
+	j->fd = fds[0];
+	path = malloc(len + 2);
+	path[0] = '!';
+	memcpy(path + 1, j->cmd, len + 1);
+	id = jobOpen(j, path);
+
+	/* output is shown below, focus stays where it was */
+	if (CURWIN.r >= 2 * WINROWSMIN) {
+		winsplit(&(Arg){ .i = SplitRows });
+		CURBUFID = id;
+		winFocus(w);
+	} else {
+		CURBUFID = id;
+	}
+}
+
+/* reads standard input into buffer, keys are read from terminal */
+static void
+stdinStart(int fd)
+{
+	Job *j = malloc(sizeof *j);
+	j->cmd = NULL;
+	j->pid = 0;
+	j->fd = fd;
+	jobOpen(j, strdup("-"));
+}
+
+/* appends output of job to its buffer, lines point into chunks read;
+   up to JOBBURST chunks are read before screen is drawn again */
+static void
+jobRead(int fd, void *p)
+{
+	Job *j = p;
+	BufId id = j->buf;
+	Buffer *b = bufGet(id);
+	Chunk *c;
+	ssize_t rb = JOBREAD, last;
+	size_t k, got = 0;
+	int dirty;
+
+	last = b ? (ssize_t)b->lines.len - 1 : 0;
+	for (k = 0; k < JOBBURST && rb == JOBREAD; ++k) {
+		c = chunkNew(JOBREAD);
+		if ((rb = read(fd, c->data, JOBREAD)) <= 0) {
+			free(c);
+			if (rb == 0 || (errno != EAGAIN && errno != EINTR))
+				jobEnd(j);
+			break;
+		}
+		got += (size_t)rb;
+		/* buffer was closed, output is thrown away */
+		if (!b) {
+			free(c);
+			continue;
+		}
+		dirty = b->dirty;
+		c = chunkShrink(c, (size_t)rb);
+		if (chunkAppend(&(b->lines), c, (size_t)rb))
+			bufShift(b, (size_t)last + 1, b->lines.len);
+		bufTouch(b, (size_t)last);
+		/* output is not a change made by user */
+		b->dirty = dirty;
+	}
+	/* focused cursor is left where user put it */
+	if (b && got)
+		bufTail(id, last, 0);
+}
+
+static void
+jobEnd(Job *j)
+{
+	Buffer *b;
+	int status, dirty;
+	char msg[128];
+
+	watchDel(j->fd);
+	close(j->fd);
+	if ((b = bufGet(j->buf)))
+		b->job = NULL;
+	/* like in file, newline ends last line of standard input
+	   instead of starting an empty one */
+	if (b && !j->pid && b->lines.len > 1 && !b->lines.data[b->lines.len - 1].len) {
+		dirty = b->dirty;
+		lineFree(b->lines.data + --b->lines.len);
+		bufShift(b, b->lines.len, b->lines.len);
+		b->dirty = dirty;
+		if (b->y >= (ssize_t)b->lines.len) {
+			b->y = (ssize_t)b->lines.len - 1;
+			b->x = 0;
+		}
+	}
+	/* standard input has no process */
+	if (j->pid) {
+		while (waitpid(j->pid, &status, 0) < 0 && errno == EINTR);
+		if (b) {
+			snprintf(msg, sizeof msg, lang_info[InfoJobDone], j->cmd,
+					WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+			minibufferPrint(msg);
+		}
+	}
+	free(j->cmd);
+	free(j);
+}
+
+/* cursors on line last of buffer, which was the last one before lines
+   were appended, go to the new last line; the focused one only if
+   focused is set */
+static void
+bufTail(BufId id, ssize_t last, int focused)
+{
+	Buffer *b = bufGet(id);
+	size_t w;
+	for (w = 0; w < be.windows.len; ++w)
+		if (be.windows.data[w].buffer == id && w != (size_t)be.focusedwin
+		&&  be.windows.data[w].cur.y == last)
+			be.windows.data[w].cur = (View){ 0, (ssize_t)b->lines.len - 1, 0, 0 };
+	if ((focused || CURBUFID != id) && b->y == last) {
+		b->y = (ssize_t)b->lines.len - 1;
+		b->x = 0;
+	}
+}
+
+#ifdef __linux__
+/* reads bytes appended to followed file since last time; file which
+   got shorter was truncated and is read again from its beginning, path
+   naming another file means it was rotated, then the new one is opened
+   once the old one is read up to its end */
+static void
+followRead(int fd, void *p)
+{
+	Follow *f = p;
+	Buffer *b = bufGet(f->buf);
+	union { struct inotify_event e; char s[4096]; } ev;
+	struct stat sb, path;
+	Chunk *c;
+	ssize_t rb, last = (ssize_t)b->lines.len - 1;
+	size_t n;
+	int dirty = b->dirty, nfd;
+
+	/* which change woke us does not matter, file is checked anyway */
+	while (read(fd, &ev, sizeof ev) > 0);
+	for (;;) {
+		if (fstat(f->fd, &sb) == 0 && sb.st_size < f->off) {
+			minibufferPrint(lang_info[InfoTruncated]);
+			f->off = 0;
+			f->nl = b->lines.data[b->lines.len - 1].len > 0;
+		}
+		for (;;) {
+			c = chunkNew(JOBREAD);
+			if ((rb = pread(f->fd, c->data, JOBREAD, f->off)) <= 0) {
+				free(c);
+				break;
+			}
+			f->off += rb;
+			c = chunkShrink(c, (size_t)rb);
+			/* newline ending the bytes before starts a line now */
+			if (f->nl) {
+				pushVector(b->lines, newLine(0));
+				bufShift(b, b->lines.len - 1, b->lines.len);
+			}
+			n = b->lines.len - 1;
+			if (chunkAppend(&(b->lines), c, (size_t)rb))
+				bufShift(b, n + 1, b->lines.len);
+			bufTouch(b, n);
+			/* and the one ending them does not, like in file */
+			if ((f->nl = c->data[rb - 1] == '\n'))
+				lineFree(b->lines.data + --b->lines.len);
+		}
+		if (stat(b->path, &path) < 0
+		||  (path.st_dev == sb.st_dev && path.st_ino == sb.st_ino)
+		||  (nfd = open(b->path, O_RDONLY | O_CLOEXEC)) < 0)
+			break;
+		close(f->fd);
+		f->fd = nfd;
+		f->off = 0;
+		f->nl = b->lines.data[b->lines.len - 1].len > 0;
+		inotify_rm_watch(fd, f->wd);
+		f->wd = inotify_add_watch(fd, b->path, FOLLOWFILE);
+		minibufferPrint(lang_info[InfoReopened]);
+	}
+	/* appended lines are not a change made by user */
+	b->dirty = dirty;
+	if ((ssize_t)b->lines.len - 1 != last)
+		bufTail(f->buf, last, 1);
+}
+
+/* follows file of current buffer from the bytes read into it on;
+   directory is watched too, so new file in place of rotated one
+   is noticed */
+static int
+followStart(BufId id)
+{
+	Buffer *b = bufGet(id);
+	Follow *f = malloc(sizeof *f);
+	struct stat sb;
+	char *dir, ch;
+
+	if ((f->fd = open(b->path, O_RDONLY | O_CLOEXEC)) < 0) {
+		free(f);
+		return -1;
+	}
+	if ((f->in = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+		close(f->fd);
+		free(f);
+		return -1;
+	}
+	dir = pathDir(b->path);
+	f->wd = inotify_add_watch(f->in, b->path, FOLLOWFILE);
+	inotify_add_watch(f->in, dir, IN_CREATE | IN_MOVED_TO);
+	free(dir);
+
+	/* file which is not the one read, or which got shorter,
+	   is read from its beginning */
+	fstat(f->fd, &sb);
+	f->off = sb.st_dev == b->sb.st_dev && sb.st_ino == b->sb.st_ino
+		&& sb.st_size >= b->sb.st_size ? b->sb.st_size : 0;
+	f->nl = f->off ? pread(f->fd, &ch, 1, f->off - 1) == 1 && ch == '\n'
+		: b->lines.data[b->lines.len - 1].len > 0;
+	f->buf = id;
+	b->follow = f;
+	watchAdd(f->in, followRead, f);
+	followRead(f->in, f);
+	return 0;
+}
+
+static void
+followEnd(Follow *f)
+{
+	Buffer *b;
+	watchDel(f->in);
+	close(f->in);
+	close(f->fd);
+	if ((b = bufGet(f->buf)))
+		b->follow = NULL;
+	free(f);
+}
+
+/* buffer was written over followed file, which is another file then,
+   but holds text of buffer; it is followed from its end on */
+static void
+followReopen(Follow *f, const struct stat *sb)
+{
+	Buffer *b = bufGet(f->buf);
+	int nfd;
+	if ((nfd = open(b->path, O_RDONLY | O_CLOEXEC)) < 0) {
+		followEnd(f);
+		minibufferPrint(lang_info[InfoFollowOff]);
+		return;
+	}
+	close(f->fd);
+	f->fd = nfd;
+	f->off = sb->st_size;
+	f->nl = 1;
+	inotify_rm_watch(f->in, f->wd);
+	f->wd = inotify_add_watch(f->in, b->path, FOLLOWFILE);
+}
+#else
+static void followRead(int fd, void *p) { (void)fd; (void)p; }
+static int followStart(BufId id) { (void)id; errno = ENOSYS; return -1; }
+static void followEnd(Follow *f) { (void)f; }
+static void followReopen(Follow *f, const struct stat *sb) { (void)f; (void)sb; }
+#endif
+
+static void
+freeBuffer(Buffer *buf)
+{
+	size_t i;
+	for (i = 0; i < buf->lines.len; ++i)
+		lineFree(buf->lines.data + i);
+	free(buf->lines.data);
+	free(buf->marks.data);
+	free(buf->bytes.data);
+	free(buf->words.data);
+	tagsFree(&(buf->tags));
+	free(buf->path);
+}
+
+/* change tracking: every change of text bumps the buffer epoch, and is
+   logged with the first line it touches or moves, so caches can ask what
+   changed since epoch; lines drawn differently get new drawgen in gen,
+   which relexing and marking bump too without changing text.  Lines
+   from end on are the ones after the change, only shifted */
+static void
+bufLog(Buffer *b, size_t at, size_t end, int shift)
+{
+	Change *last = b->changes + (b->nchanges + CHANGELOG - 1) % CHANGELOG;
+	size_t tail = end < b->lines.len ? b->lines.len - end : 0;
+	++(b->epoch);
+	++(b->drawgen);
+	b->dirty = 1;
+	/* repeated change of the same place, e.g. typing or opening
+	   line after line, is one change */
+	if (b->nchanges && (last->at == at
+	||  ((last->shift || shift) && last->at + 1 == at))) {
+		last->epoch = b->epoch;
+		last->shift |= shift;
+		if (tail < last->tail)
+			last->tail = tail;
+		return;
+	}
+	b->changes[b->nchanges++ % CHANGELOG] = (Change){ b->epoch, at, shift, tail };
+}
+
+static void
+bufTouch(Buffer *b, size_t y)
+{
+	bufLog(b, y, y + 1, 0);
+	b->lines.data[y].gen = b->drawgen;
+	b->lines.data[y].hlin = SYNSTALE;
+}
+
+/* lines [at, end) were inserted or moved, or ones at at removed */
+static void
+bufShift(Buffer *b, size_t at, size_t end)
+{
+	bufLog(b, at, end, 1);
+}
+
+/* buffer still being read in background is neither changed nor written,
+   its lines are replaced once its file is read */
+static int
+bufLoading(const Buffer *b)
+{
+	return b->load ? minibufferError(lang_err[ErrLoading]) : 0;
+}
+
+/* first line changed since epoch; if shifted is given, it gets the first
+   line which may be another one than it was; SIZE_MAX if none */
+static size_t
+bufChangedSince(const Buffer *b, unsigned long epoch, size_t *shifted)
+{
+	size_t i, at = SIZE_MAX, sh = SIZE_MAX;
+	const Change *c;
+	for (i = 0; i < b->nchanges; ++i) {
+		if (i == CHANGELOG) {
+			at = sh = 0; /* forgotten */
+			break;
+		}
+		c = b->changes + (b->nchanges - 1 - i) % CHANGELOG;
+		if (c->epoch <= epoch)
+			break;
+		if (c->at < at) at = c->at;
+		if (c->shift && c->at < sh) sh = c->at;
+	}
+	if (shifted) *shifted = sh;
+	return at;
+}
+
+/* lines at end of buffer no change since epoch touched,
+   though they may be shifted */
+static size_t
+bufTailSince(const Buffer *b, unsigned long epoch)
+{
+	size_t i, tail = b->lines.len;
+	const Change *c;
+	for (i = 0; i < b->nchanges; ++i) {
+		if (i == CHANGELOG)
+			return 0; /* forgotten */
+		c = b->changes + (b->nchanges - 1 - i) % CHANGELOG;
+		if (c->epoch <= epoch)
+			break;
+		if (c->tail < tail) tail = c->tail;
+	}
+	return tail;
+}
+
+static inline int
+lineChangedSince(const Buffer *b, size_t y, unsigned long gen, size_t shifted)
+{
+	return y >= shifted || b->lines.data[y].gen > gen;
+}
+
+/* byte offsets: Fenwick tree over lengths of lines, newlines included,
+   node i of tree being bytes.data[i - 1].  It is brought up to date
+   with logged changes when asked: lines changed in place are updated,
+   nodes from the first shifted line on are summed again */
+static size_t
+bytesSum(const Buffer *b, size_t y)
+{
+	size_t s = 0;
+	for (; y; y -= LOWBIT(y))
+		s += b->bytes.data[y - 1];
+	return s;
+}
+
+static void
+bytesSync(Buffer *b)
+{
+	size_t i, j, k, d, n = b->lines.len, sh = b->bytes.len;
+	const Change *c;
+
+	if (b->bytesepoch == b->epoch && sh == n)
+		return;
+	for (k = 0; k < b->nchanges && sh; ++k) {
+		if (k == CHANGELOG) {
+			sh = 0; /* forgotten */
+			break;
+		}
+		c = b->changes + (b->nchanges - 1 - k) % CHANGELOG;
+		if (c->epoch <= b->bytesepoch)
+			break;
+		if (c->shift && c->at < sh)
+			sh = c->at;
+	}
+	if (sh > n)
+		sh = n;
+	/* lines before sh kept their places, changes of their
+	   lengths go up the tree */
+	for (k = 0; k < b->nchanges && k < CHANGELOG && sh; ++k) {
+		c = b->changes + (b->nchanges - 1 - k) % CHANGELOG;
+		if (c->epoch <= b->bytesepoch)
+			break;
+		if (c->at >= sh)
+			continue;
+		d = b->lines.data[c->at].len + 1
+			- (bytesSum(b, c->at + 1) - bytesSum(b, c->at));
+		for (i = c->at + 1; i <= b->bytes.len; i += LOWBIT(i))
+			b->bytes.data[i - 1] += d; /* wraps when line got shorter */
+	}
+	if (b->bytes.len != n) {
+		b->bytes.data = realloc(b->bytes.data, n * sizeof *(b->bytes.data));
+		b->bytes.len = n;
+	}
+	for (i = sh + 1; i <= n; ++i)
+		b->bytes.data[i - 1] = b->lines.data[i - 1].len + 1;
+	/* nodes before sh whose parents are summed again are the ones
+	   sum of first sh lines consists of */
+	for (i = sh; i; i -= LOWBIT(i))
+		if ((j = i + LOWBIT(i)) <= n)
+			b->bytes.data[j - 1] += b->bytes.data[i - 1];
+	for (i = sh + 1; i <= n; ++i)
+		if ((j = i + LOWBIT(i)) <= n)
+			b->bytes.data[j - 1] += b->bytes.data[i - 1];
+	b->bytesepoch = b->epoch;
+}
+
+/* bytes of lines before line y */
+static size_t
+bytesBefore(Buffer *b, size_t y)
+{
+	bytesSync(b);
+	return bytesSum(b, y);
+}
+
+/* line containing byte off, x gets its offset in line;
+   -1 if buffer is not that long */
+static ssize_t
+bytesLine(Buffer *b, size_t off, size_t *x)
+{
+	size_t n, step, y;
+	bytesSync(b);
+	n = b->bytes.len;
+	for (step = 1; step <= n / 2; step <<= 1);
+	for (y = 0; step; step >>= 1) {
+		if (y + step <= n && b->bytes.data[y + step - 1] <= off) {
+			y += step;
+			off -= b->bytes.data[y - 1];
+		}
+	}
+	if (y >= n)
+		return -1;
+	*x = off;
+	return (ssize_t)y;
+}
+
+/* words: every buffer keeps references to its lines as their words
+   were counted in index, so line which changed since is another Line
+   storage, or has another length; changes are found from the log and
+   by comparing lines, then words of lines which differ are counted
+   out of index and in again.  Edits in place count only words around
+   them right away.  Index is shared with background jobs, so it is
+   used with its lock held; nodes left empty are reused */
+static uint32_t
+wordFind(const char *s, size_t n, int create)
+{
+	WordNode *t;
+	uint32_t i = be.words.nodes.data[0].next[1], parent = 0;
+	size_t k = 0;
+	int dir = 1;
+
+	while (k < n) {
+		if (!i) {
+			if (!create)
+				return 0;
+			if ((i = be.words.free)) {
+				be.words.free = be.words.nodes.data[i].next[0];
+				be.words.nodes.data[i] = (WordNode){ { 0, 0, 0 }, 0, s[k] };
+			} else {
+				i = (uint32_t)be.words.nodes.len;
+				pushVector(be.words.nodes, ((WordNode){ { 0, 0, 0 }, 0, s[k] }));
+			}
+			be.words.nodes.data[parent].next[dir] = i;
+		}
+		t = be.words.nodes.data + i;
+		parent = i;
+		if (s[k] != t->c)
+			dir = s[k] < t->c ? 0 : 2;
+		else if (++k < n)
+			dir = 1;
+		else
+			break;
+		i = t->next[dir];
+	}
+	return i;
+}
+
+/* takes nodes of s[0, n) left without count and children out of
+   branch i, so they are reused; gives what takes place of branch */
+static uint32_t
+wordPrune(uint32_t i, const char *s, size_t n)
+{
+	WordNode *t = be.words.nodes.data + i;
+	int dir;
+	if (!i)
+		return 0;
+	if (s[0] != t->c) {
+		dir = s[0] < t->c ? 0 : 2;
+		t->next[dir] = wordPrune(t->next[dir], s, n);
+	} else if (n > 1) {
+		t->next[1] = wordPrune(t->next[1], s + 1, n - 1);
+	}
+	if (t->count || t->next[0] || t->next[1] || t->next[2])
+		return i;
+	t->next[0] = be.words.free;
+	be.words.free = i;
+	return 0;
+}
+
+/* counts words of s in (d = 1) or out (d = -1) of index; jobs
+   may count out before others count in, so both make nodes */
+static void
+wordsSpan(String s, int d)
+{
+	String w;
+	uint32_t i;
+	while (s.len) {
+		w = Striden(s);
+		/* finding may grow nodes, so they are indexed after it */
+		if (w.len >= WORDMIN && w.len <= WORDMAX) {
+			i = wordFind(w.data, w.len, 1);
+			if (!(be.words.nodes.data[i].count += d))
+				be.words.nodes.data[0].next[1] =
+					wordPrune(be.words.nodes.data[0].next[1], w.data, w.len);
+		}
+		w.len = w.len ? w.len : 1;
+		s.data += w.len;
+		s.len -= w.len;
+	}
+}
+
+static void
+wordsLine(const Line *l, int d)
+{
+	wordsSpan((String){ l->data, l->len }, d);
+}
+
+/* counts words of line overlapping [x1, x2) in or out, they being
+   all its words an edit in place of [x1, x2) changes */
+static void
+wordsAround(const Line *l, size_t x1, size_t x2, int d)
+{
+	while (x1 && Striden((String){ l->data + x1 - 1, 1 }).len)
+		--x1;
+	while (x2 < l->len && Striden((String){ l->data + x2, 1 }).len)
+		++x2;
+	pthread_mutex_lock(&be.words.lock);
+	wordsSpan((String){ l->data + x1, x2 - x1 }, d);
+	pthread_mutex_unlock(&be.words.lock);
+}
+
+/* lock is taken for every line, so completion does not wait
+   for whole job */
+static void
+wordsCount(WordJob *j)
+{
+	size_t i;
+	for (i = 0; i < j->del.len + j->add.len; ++i) {
+		pthread_mutex_lock(&be.words.lock);
+		if (i < j->del.len)
+			wordsLine(j->del.data + i, -1);
+		else
+			wordsLine(j->add.data + i - j->del.len, 1);
+		pthread_mutex_unlock(&be.words.lock);
+	}
+}
+
+static void *
+wordsThread(void *p)
+{
+	WordJob *j = p;
+	wordsCount(j);
+	/* references to lines are given back by main thread */
+	if (write(be.words.pipe[1], &j, sizeof j) != sizeof j)
+		die("write:");
+	return NULL;
+}
+
+static void
+wordsFree(WordJob *j)
+{
+	size_t i;
+	for (i = 0; i < j->del.len; ++i)
+		lineFree(j->del.data + i);
+	for (i = 0; i < j->add.len; ++i)
+		lineFree(j->add.data + i);
+	free(j->del.data);
+	free(j->add.data);
+	free(j);
+}
+
+static void
+wordsDone(int fd, void *p)
+{
+	WordJob *j;
+	(void)p;
+	while (read(fd, &j, sizeof j) == sizeof j)
+		wordsFree(j);
+}
+
+/* counts lines of job, in background if there are many */
+static void
+wordsRun(WordJob *j)
+{
+	pthread_t t;
+	if (j->del.len + j->add.len >= WORDSYNC
+	&& !pthread_create(&t, NULL, wordsThread, j)) {
+		pthread_detach(t);
+		return;
+	}
+	wordsCount(j);
+	wordsFree(j);
+}
+
+/* line y of buffer and its indexed one are compared in place */
+static void
+wordsPair(Buffer *b, WordJob *j, size_t y)
+{
+	Line *o = b->words.data + y, *l = b->lines.data + y;
+	if (o->data == l->data && o->len == l->len)
+		return;
+	pushVector(j->del, *o);
+	*o = lineRef(*l);
+	pushVector(j->add, lineRef(*l));
+}
+
+static void
+wordsSync(Buffer *b)
+{
+	WordJob *j;
+	Line *o = b->words.data, *l = b->lines.data;
+	size_t at, sh, k, a, m = b->words.len, n = b->lines.len, om, ln;
+	const Change *c;
+
+	/* lines still coming are counted once they stop */
+	if ((b->wordsepoch == b->epoch && m == n) || b->job || b->follow)
+		return;
+	j = malloc(sizeof *j);
+	newVector(j->del);
+	newVector(j->add);
+	at = bufChangedSince(b, b->wordsepoch, &sh);
+	if (sh == SIZE_MAX && m == n) {
+		/* lines were only changed in place */
+		for (k = 0; k < b->nchanges; ++k) {
+			c = b->changes + (b->nchanges - 1 - k) % CHANGELOG;
+			if (c->epoch <= b->wordsepoch)
+				break;
+			wordsPair(b, j, c->at);
+		}
+	} else {
+		/* lines between same beginning and end differ */
+		a = at < m ? at : m;
+		for (a = a < n ? a : n; a < m && a < n
+				&& o[a].data == l[a].data && o[a].len == l[a].len; ++a);
+		for (om = m, ln = n; om > a && ln > a && o[om - 1].data == l[ln - 1].data
+				&& o[om - 1].len == l[ln - 1].len; --om, --ln);
+		if (om - a == ln - a) {
+			for (k = a; k < om; ++k)
+				wordsPair(b, j, k);
+		} else {
+			j->del.data = realloc(j->del.data, (om - a) * sizeof *o);
+			memcpy(j->del.data, o + a, (j->del.len = om - a) * sizeof *o);
+			j->add.data = realloc(j->add.data, (ln - a) * sizeof *o);
+			j->add.len = ln - a;
+			if (n > m)
+				o = b->words.data = realloc(o, n * sizeof *o);
+			memmove(o + ln, o + om, (m - om) * sizeof *o);
+			for (k = a; k < ln; ++k) {
+				o[k] = lineRef(l[k]);
+				j->add.data[k - a] = lineRef(l[k]);
+			}
+			b->words.len = n;
+		}
+	}
+	b->wordsepoch = b->epoch;
+	wordsRun(j);
+}
+
+static void
+wordsSyncAll(void)
+{
+	size_t i;
+	for (i = be.buffers.data[0].next; i; i = be.buffers.data[i].next)
+		wordsSync(&(be.buffers.data[i].b));
+}
+
+/* words of closed buffer are counted out */
+static void
+wordsDrop(Buffer *b)
+{
+	WordJob *j = malloc(sizeof *j);
+	j->del = b->words;
+	newVector(j->add);
+	newVector(b->words);
+	wordsRun(j);
+}
+
+/* puts words following w[0, n) found from node i into candidates,
+   in order */
+static void
+wordsCollect(uint32_t i, char *w, size_t n)
+{
+	const WordNode *t;
+	if (!i || be.completion.cands.len >= COMPLETEMAX || n >= WORDMAX)
+		return;
+	t = be.words.nodes.data + i;
+	wordsCollect(t->next[0], w, n);
+	w[n] = t->c;
+	if (t->count > 0 && be.completion.cands.len < COMPLETEMAX)
+		pushVector(be.completion.cands, strndup(w, n + 1));
+	wordsCollect(t->next[1], w, n + 1);
+	wordsCollect(t->next[2], w, n);
+}
+
+/* tags: definitions of C functions, types and macros, found by a
+   tokenizer counting braces and parentheses.  Buffers are scanned
+   in background from the last line started on top level before their
+   first change, tags above it are kept.  Scanning stops at a line past
+   the last change where it is on top level like the old scan was, as
+   it would find the same tags after it, only shifted */
+static inline int
+tagIdent(char c)
+{
+	return isalnum((unsigned char)c) || c == '_';
+}
+
+/* on top level with no token pending, so scanning from here
+   does not depend on what was before */
+static inline int
+tagIdle(const TagScan *st)
+{
+	return !st->comment && !st->directive && !st->depth && !st->paren
+	    && !st->cand.s && !st->typedefs && !st->sue && !st->ident && !st->star;
+}
+
+static void
+tagAdd(Tags *t, const TagName *n, const TagScan *st)
+{
+	pushVector(*t, ((Tag){ strndup(n->s, n->n), NULL, n->y, n->x, st->top }));
+}
+
+static void
+tagLine(TagScan *st, const Line *l, size_t y, Tags *out)
+{
+	const char *d = l->data;
+	size_t x = 0, e, n = l->len;
+	TagName w;
+	char c;
+
+	if (st->directive) {
+		st->directive = n && d[n - 1] == '\\';
+		return;
+	}
+	if (tagIdle(st))
+		st->top = y;
+	while (x < n && (d[x] == ' ' || d[x] == '\t')) ++x;
+	if (!st->comment && x < n && d[x] == '#') {
+		for (++x; x < n && (d[x] == ' ' || d[x] == '\t'); ++x);
+		if (n - x > 7 && !memcmp(d + x, "define", 6)
+		&& (d[x + 6] == ' ' || d[x + 6] == '\t')) {
+			for (x += 7; x < n && (d[x] == ' ' || d[x] == '\t'); ++x);
+			for (e = x; e < n && tagIdent(d[e]); ++e);
+			if (e > x)
+				tagAdd(out, &(TagName){ d + x, e - x, y, x }, st);
+		}
+		st->directive = n && d[n - 1] == '\\';
+		return;
+	}
+	while (x < n) {
+		c = d[x];
+		if (st->comment) {
+			if (c == '*' && x + 1 < n && d[x + 1] == '/') {
+				st->comment = 0;
+				++x;
+			}
+			++x;
+			continue;
+		}
+		if (c == '/' && x + 1 < n && d[x + 1] == '/')
+			return;
+		if (c == '/' && x + 1 < n && d[x + 1] == '*') {
+			st->comment = 1;
+			x += 2;
+			continue;
+		}
+		if (c == '"' || c == '\'') {
+			for (++x; x < n && d[x] != c; ++x)
+				if (d[x] == '\\') ++x;
+			++x;
+			st->ident = st->star = 0;
+			continue;
+		}
+		if (tagIdent(c)) {
+			for (e = x; e < n && tagIdent(d[e]); ++e);
+			w = (TagName){ d + x, e - x, y, x };
+			st->ident = !isdigit((unsigned char)c);
+			if (st->depth || !st->ident) {
+				/* only names on top level matter */
+			} else if (w.n == 7 && !memcmp(w.s, "typedef", 7)) {
+				st->typedefs = 1;
+				st->ident = 0;
+				st->last.s = NULL;
+			} else if ((w.n == 6 && !memcmp(w.s, "struct", 6))
+			|| (w.n == 5 && !memcmp(w.s, "union", 5))
+			|| (w.n == 4 && !memcmp(w.s, "enum", 4))) {
+				st->sue = 1;
+				st->ident = 0;
+			} else {
+				if (st->sue == 1) {
+					st->suename = w;
+					st->sue = 2;
+				}
+				/* type of typedef may be macro call */
+				if (!st->paren && (!st->params || st->typedefs))
+					st->last = w;
+				/* typedef of pointer to function */
+				if (st->typedefs && st->paren == 1 && st->star)
+					st->tdef = w;
+			}
+			st->star = 0;
+			x = e;
+			continue;
+		}
+		switch (c) {
+		case '(':
+			if (!st->depth && !st->paren && st->ident && !st->params)
+				st->cand = st->last;
+			++st->paren;
+			break;
+		case ')':
+			if (st->paren && !--st->paren && !st->depth && st->cand.s)
+				st->params = 1;
+			break;
+		case '{':
+			if (!st->depth) {
+				if (st->params && !st->typedefs)
+					tagAdd(out, &st->cand, st);
+				else if (st->sue == 2)
+					tagAdd(out, &st->suename, st);
+				st->cand.s = NULL;
+				st->params = st->sue = 0;
+			}
+			++st->depth;
+			break;
+		case '}':
+			if (st->depth)
+				--st->depth;
+			break;
+		case ';': case ',':
+			if (st->depth || st->paren)
+				break;
+			if (st->typedefs && (st->tdef.s || st->last.s))
+				tagAdd(out, st->tdef.s ? &st->tdef : &st->last, st);
+			st->cand.s = st->tdef.s = NULL;
+			st->params = st->sue = 0;
+			if (c == ';') {
+				st->typedefs = 0;
+				st->last.s = NULL;
+			}
+			break;
+		case '=':
+			if (!st->depth && !st->paren) {
+				st->cand.s = NULL;
+				st->params = st->sue = 0;
+			}
+			break;
+		}
+		st->ident = 0;
+		st->star = c == '*';
+		++x;
+	}
+}
+
+/* scans C files under dir, paths of files with tags go to j->files */
+static void
+tagDir(TagJob *j, const char *dir, int depth)
+{
+	DIR *d;
+	struct dirent *e;
+	struct stat sb;
+	TagScan st;
+	Lines lines;
+	char *path;
+	size_t i, len, n;
+
+	if (depth > TAGDEPTH || !(d = opendir(dir)))
+		return;
+	while ((e = readdir(d))) {
+		if (*e->d_name == '.')
+			continue;
+		len = strlen(e->d_name);
+		path = malloc(strlen(dir) + len + 2);
+		/* files of current directory are named like when opened */
+		if (strcmp(dir, "."))
+			sprintf(path, "%s/%s", dir, e->d_name);
+		else
+			strcpy(path, e->d_name);
+		if (lstat(path, &sb) < 0) {
+			/* removed while directory was read */
+		} else if (S_ISDIR(sb.st_mode)) {
+			tagDir(j, path, depth + 1);
+		} else if (S_ISREG(sb.st_mode) && len > 2 && e->d_name[len - 2] == '.'
+		&& (e->d_name[len - 1] == 'c' || e->d_name[len - 1] == 'h')
+		&& fileRead(path, &lines, &sb) == 0) {
+			memset(&st, 0, sizeof st);
+			n = j->tags.len;
+			for (i = 0; i < lines.len; ++i)
+				tagLine(&st, lines.data + i, i, &(j->tags));
+			for (i = 0; i < lines.len; ++i)
+				lineFree(lines.data + i);
+			free(lines.data);
+			if (j->tags.len > n) {
+				for (i = n; i < j->tags.len; ++i)
+					j->tags.data[i].path = path;
+				pushVector(j->files, path);
+				path = NULL;
+			}
+		}
+		free(path);
+	}
+	closedir(d);
+}
+
+static int
+tagCompare(const void *a, const void *b)
+{
+	return strcmp(((const Tag *)a)->name, ((const Tag *)b)->name);
+}
+
+static void *
+tagThread(void *p)
+{
+	TagJob *j = p;
+	size_t k = 0, y;
+
+	if (j->dir) {
+		tagDir(j, j->dir, 0);
+		qsort(j->tags.data, j->tags.len, sizeof *(j->tags.data), tagCompare);
+	} else {
+		/* on top level where the old scan was, the rest is known */
+		for (;; ++(j->scanned)) {
+			y = j->from + j->scanned;
+			for (; k < j->stops.len && j->stops.data[k] < y; ++k);
+			if (k < j->stops.len && j->stops.data[k] == y && tagIdle(&(j->st))) {
+				j->stop = y;
+				break;
+			}
+			if (j->scanned == j->lines.len)
+				break;
+			tagLine(&(j->st), j->lines.data + j->scanned, y, &(j->tags));
+		}
+	}
+	if (write(be.tags.pipe[1], &j, sizeof j) != sizeof j)
+		die("write:");
+	return NULL;
+}
+
+static void
+tagsFree(Tags *t)
+{
+	size_t i;
+	for (i = 0; i < t->len; ++i)
+		free(t->data[i].name);
+	free(t->data);
+}
+
+/* gives job next batch of lines, up to the next line past every
+   change the old scan was on top level at, then to twice as many of
+   them each time, or up to the end if there are no more */
+static void
+tagMore(Buffer *b, TagJob *j)
+{
+	size_t k, at = j->from + j->lines.len, end = b->lines.len, tail, y;
+	const Tag *t;
+
+	j->batch = j->batch ? 2 * j->batch : 1;
+	j->stops.len = 0;
+	if ((tail = bufTailSince(b, b->tagepoch)) > b->taglen)
+		tail = b->taglen;
+	for (k = 0; k < b->tags.len && j->stops.len < j->batch; ++k) {
+		t = b->tags.data + k;
+		if (t->top + tail < b->taglen
+		||  (y = t->top + b->lines.len - b->taglen) <= at
+		||  (j->stops.len && j->stops.data[j->stops.len - 1] == y))
+			continue;
+		pushVector(j->stops, y);
+		end = y;
+	}
+	j->lines.data = realloc(j->lines.data, (end - j->from) * sizeof *(j->lines.data));
+	for (; j->lines.len < end - j->from; ++(j->lines.len))
+		j->lines.data[j->lines.len] = lineRef(b->lines.data[j->from + j->lines.len]);
+	j->epoch = b->epoch;
+	j->len = b->lines.len;
+}
+
+static void
+tagStart(TagJob *j)
+{
+	pthread_t t;
+	if (pthread_create(&t, NULL, tagThread, j))
+		tagThread(j);
+	else
+		pthread_detach(t);
+}
+
+/* tags of finished job replace the ones of buffer from line from on,
+   up to the line the old scan stopped at if it was on top level there
+   too; then tags after it are shifted, else scanning goes on while lines
+   scanned are unchanged.  Tags of directory replace the old ones */
+static void
+tagDone(int fd, void *p)
+{
+	TagJob *j;
+	Buffer *b;
+	size_t i, k, m, len, old;
+	char msg[PATH_MAX + 64];
+	(void)p;
+
+	while (read(fd, &j, sizeof j) == sizeof j) {
+		if (j->dir) {
+			tagsFree(&(be.tags.dir));
+			for (i = 0; i < be.tags.files.len; ++i)
+				free(be.tags.files.data[i]);
+			free(be.tags.files.data);
+			be.tags.dir = j->tags;
+			be.tags.files.data = j->files.data;
+			be.tags.files.len = j->files.len;
+			be.tags.scanning = 0;
+			snprintf(msg, sizeof msg, lang_info[InfoTagsDone],
+					(unsigned long)be.tags.dir.len, j->dir);
+			minibufferPrint(msg);
+			free(j->dir);
+		} else if ((b = bufGet(j->buf)) && j->stop == SIZE_MAX
+		&& j->from + j->lines.len < j->len) {
+			/* batch did not meet old scan: next one if lines scanned
+			   are unchanged, else it starts again */
+			if (bufChangedSince(b, j->epoch, NULL) >= j->from + j->lines.len) {
+				tagMore(b, j);
+				tagStart(j);
+				continue;
+			}
+			tagsFree(&(j->tags));
+			b->tagjob = NULL;
+		} else if (b) {
+			old = j->stop == SIZE_MAX ? SIZE_MAX : j->stop + b->taglen - j->len;
+			for (k = 0; k < b->tags.len && b->tags.data[k].y < j->from; ++k);
+			for (m = k; m < b->tags.len && b->tags.data[m].top < old; ++m)
+				free(b->tags.data[m].name);
+			len = k + j->tags.len + b->tags.len - m;
+			if (len > b->tags.len)
+				b->tags.data = realloc(b->tags.data, len * sizeof *(b->tags.data));
+			memmove(b->tags.data + k + j->tags.len, b->tags.data + m,
+					(b->tags.len - m) * sizeof *(b->tags.data));
+			memcpy(b->tags.data + k, j->tags.data,
+					j->tags.len * sizeof *(j->tags.data));
+			for (i = k + j->tags.len; i < len; ++i) {
+				b->tags.data[i].y = b->tags.data[i].y - old + j->stop;
+				b->tags.data[i].top = b->tags.data[i].top - old + j->stop;
+			}
+			b->tags.len = len;
+			b->tagepoch = j->epoch;
+			b->taglen = j->len;
+			b->tagged = 1;
+			b->tagjob = NULL;
+			free(j->tags.data);
+		} else {
+			/* buffer was closed while it was scanned */
+			tagsFree(&(j->tags));
+		}
+		for (i = 0; i < j->lines.len; ++i)
+			lineFree(j->lines.data + i);
+		free(j->lines.data);
+		free(j->stops.data);
+		free(j);
+	}
+}
+
+/* starts scanning lines of C buffer changed since its tags were */
+static void
+tagSync(BufId id)
+{
+	Buffer *b = bufGet(id);
+	TagJob *j;
+	size_t at, k, r = 0;
+
+	if (!b->syntax || strcmp(b->syntax->name, "c") || b->load || b->tagjob
+	|| (b->tagged && b->tagepoch == b->epoch))
+		return;
+	at = b->tagged ? bufChangedSince(b, b->tagepoch, NULL) : 0;
+	for (k = 0; k < b->tags.len && b->tags.data[k].top <= at; ++k)
+		r = b->tags.data[k].top;
+	if (r > b->lines.len)
+		r = b->lines.len;
+	j = calloc(1, sizeof *j);
+	j->buf = id;
+	j->from = r;
+	j->stop = SIZE_MAX;
+	newVector(j->lines);
+	newVector(j->stops);
+	newVector(j->tags);
+	newVector(j->files);
+	tagMore(b, j);
+	b->tagjob = j;
+	tagStart(j);
+}
+
+static void
+tagSyncAll(void)
+{
+	size_t i;
+	for (i = be.buffers.data[0].next; i; i = be.buffers.data[i].next)
+		tagSync(BUFID(i, be.buffers.data[i].gen));
+}
+
+/* definition of name, looked for in focused buffer first, then in the
+   other ones and in directory scanned; id gets its buffer, BUFNONE if
+   it is in directory */
+static const Tag *
+tagFind(const char *name, size_t n, BufId *id)
+{
+	const Tag *t;
+	Buffer *b;
+	BufId i = CURBUFID;
+	size_t k, lo, hi, mid;
+	int r;
+
+	do {
+		b = bufGet(i);
+		for (k = 0; k < b->tags.len; ++k) {
+			t = b->tags.data + k;
+			if (!strncmp(t->name, name, n) && !t->name[n]) {
+				*id = i;
+				return t;
+			}
+		}
+		i = bufStep(i, 1);
+	} while (i != CURBUFID);
+	*id = BUFNONE;
+	for (lo = 0, hi = be.tags.dir.len; lo < hi;) {
+		mid = lo + (hi - lo) / 2;
+		t = be.tags.dir.data + mid;
+		if (!(r = strncmp(name, t->name, n)) && t->name[n])
+			r = -1;
+		if (!r)
+			return t;
+		if (r < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return NULL;
+}
+
+/* moves to definition of name, opening its file if it is not open */
+static void
+tagGo(const char *name, size_t n)
+{
+	const Tag *t;
+	Buffer *b;
+	BufId id;
+	struct stat sb;
+	size_t i;
+
+	if (!(t = tagFind(name, n, &id))) {
+		minibufferError(lang_err[ErrNoTag]);
+		return;
+	}
+	if (id == BUFNONE) {
+		if (stat(t->path, &sb) < 0) {
+			minibufferError(strerror(errno));
+			return;
+		}
+		for (i = be.buffers.data[0].next; i; i = be.buffers.data[i].next) {
+			b = &(be.buffers.data[i].b);
+			if (b->path && (!strcmp(b->path, t->path)
+			|| (b->sb.st_ino == sb.st_ino && b->sb.st_dev == sb.st_dev)))
+				id = BUFID(i, be.buffers.data[i].gen);
+		}
+		if (id == BUFNONE && (id = editBuffer(t->path)) == BUFNONE) {
+			minibufferError(strerror(errno));
+			return;
+		}
+	}
+	CURBUFID = id;
+	b = &CURBUF;
+	b->y = t->y < b->lines.len ? (ssize_t)t->y : (ssize_t)b->lines.len - 1;
+	b->x = t->x < b->lines.data[b->y].len ? (ssize_t)t->x : 0;
+}
+
+/* syntax */
+static const Syntax *
+synDetect(const Buffer *b)
+{
+	size_t i, n, namelen;
+	const char *m;
+	const Line *first = b->lines.data;
+	if (!b->name)
+		return NULL;
+	namelen = strlen(b->name);
+	for (i = 0; i < LEN(syntaxes); ++i) {
+		for (m = syntaxes[i].match; *m; m += n) {
+			m += strspn(m, " ");
+			n = strcspn(m, " ");
+			if (!n) break;
+			if (m[0] == '#' && m[1] == '!') {
+				if (first->len >= n && !memcmp(first->data, m, n))
+					return syntaxes + i;
+			} else if (m[0] == '.' ? namelen >= n &&
+					!memcmp(b->name + namelen - n, m, n) :
+					namelen == n && !memcmp(b->name, m, n)) {
+				return syntaxes + i;
+			}
+		}
+	}
+	return NULL;
+}
+
+#define SYNWORD(C) (isalnum((unsigned char)(C)) || (C) == '_')
+
+/* lexes line l entered in state, returning state at its end;
+   if hl is given, it gets highlight of every byte */
+static int
+synLex(const Syntax *s, const Line *l, int state, unsigned char *hl)
+{
+	const char *p = l->data, *q;
+	size_t x = 0, n, len = l->len;
+	size_t clen = s->comment ? strlen(s->comment) : 0;
+	size_t olen = s->open ? strlen(s->open) : 0;
+	size_t elen = s->close ? strlen(s->close) : 0;
+	Highlight base = HlNormal;
+	const SynWord *w;
+
+#define PAINT(HL, N) do { \
+	if (hl) memset(hl + x, (int)(HL), (N)); \
+	x += (N); \
+} while (0)
+	if (s->directive) {
+		for (n = 0; n < len && isspace((unsigned char)p[n]); ++n);
+		if (n < len && p[n] == s->directive && state == SynNormal)
+			base = HlPreproc;
+	}
+	while (x < len) {
+		if (state == SynComment) {
+			if (len - x >= elen && !memcmp(p + x, s->close, elen)) {
+				PAINT(HlComment, elen);
+				state = SynNormal;
+			} else {
+				PAINT(HlComment, 1);
+			}
+		} else if (state >= SynString) {
+			if (p[x] == '\\' && x + 1 < len) {
+				PAINT(HlString, 2);
+			} else {
+				if (p[x] == s->quotes[state - SynString])
+					state = SynNormal;
+				PAINT(HlString, 1);
+			}
+		} else if (clen && len - x >= clen && !memcmp(p + x, s->comment, clen)
+				&& (!x || (!SYNWORD(p[x - 1]) && p[x - 1] != s->variable))) {
+			PAINT(HlComment, len - x);
+		} else if (olen && len - x >= olen && !memcmp(p + x, s->open, olen)) {
+			PAINT(HlComment, olen);
+			state = SynComment;
+		} else if (s->quotes && p[x] && (q = strchr(s->quotes, p[x]))) {
+			PAINT(HlString, 1);
+			state = SynString + (int)(q - s->quotes);
+		} else if (s->variable && p[x] == s->variable
+				&& x + 1 < len && SYNWORD(p[x + 1])) {
+			for (n = 2; x + n < len && SYNWORD(p[x + n]); ++n);
+			PAINT(HlType, n);
+		} else if (isdigit((unsigned char)p[x])) {
+			for (n = 1; x + n < len && (SYNWORD(p[x + n]) || p[x + n] == '.'); ++n);
+			PAINT(HlNumber, n);
+		} else if (SYNWORD(p[x])) {
+			for (n = 1; x + n < len && SYNWORD(p[x + n]); ++n);
+			for (w = s->words; w && w->word; ++w)
+				if (!strncmp(w->word, p + x, n) && !w->word[n])
+					break;
+			PAINT(w && w->word ? w->hl : base, n);
+		} else {
+			PAINT(base, 1);
+		}
+	}
+#undef PAINT
+	/* unterminated string ends with the line, unless continued */
+	if (state >= SynString && !s->multiline && !(len && p[len - 1] == '\\'))
+		state = SynNormal;
+	return state;
+}
+
+/* state after line y entered in state, lexing it only if its cached
+   state is stale; line which lexes differently is shown differently,
+   so it gets a new generation */
+static int
+synLine(Buffer *b, size_t y, int state)
+{
+	Line *l = b->lines.data + y;
+	if (l->hlin == state)
+		return l->hl;
+	lineCheck(b, y);
+	l->hlin = (unsigned char)state;
+	l->hl = (unsigned char)synLex(b->syntax, l, state, NULL);
+	l->gen = ++(b->drawgen);
+	return l->hl;
+}
+
+/* makes states of lines [from, upto] usable for drawing; lines are lexed
+   lazily from the first changed one, reusing cached states once they
+   converge again; far beyond that, lexing starts syncback lines
+   before from as a guess, instead of lexing the whole file */
+static void
+synSync(Buffer *b, size_t from, size_t upto)
+{
+	size_t y, first;
+	int state;
+	if (!b->syntax) return;
+	if (upto >= b->lines.len) upto = b->lines.len - 1;
+	first = bufChangedSince(b, b->synepoch, NULL);
+	if (first < b->synvalid) b->synvalid = first;
+	b->synepoch = b->epoch;
+	if (b->synvalid > upto) return;
+	if (from > b->synvalid + syncback) {
+		for (y = from - syncback, state = SynNormal; y <= upto; ++y)
+			state = synLine(b, y, state);
+		b->synepoch = b->epoch;
+		return;
+	}
+	y = b->synvalid;
+	for (state = y ? b->lines.data[y - 1].hl : SynNormal; y <= upto; ++y)
+		state = synLine(b, y, state);
+	b->synvalid = y;
+	b->synepoch = b->epoch;
+}
+
+/* marks */
+static inline int
+markGet(Buffer *b, size_t y)
+{
+	return y / MARKBITS < b->marks.len
+		&& (b->marks.data[y / MARKBITS] >> (y % MARKBITS) & 1);
+}
+
+static void
+markToggle(Buffer *b, size_t y)
+{
+	while (y / MARKBITS >= b->marks.len)
+		pushVector(b->marks, 0);
+	b->marks.data[y / MARKBITS] ^= 1UL << (y % MARKBITS);
+	if (y < b->lines.len) {
+		lineCheck(b, y);
+		b->lines.data[y].gen = ++(b->drawgen);
+	}
+	marksTrim(b);
+}
+
+static size_t
+markCount(Buffer *b)
+{
+	size_t i, n;
+	for (i = n = 0; i < b->marks.len; ++i)
+#ifdef __GNUC__
+		n += (size_t)__builtin_popcountl(b->marks.data[i]);
+#else
+	{
+		unsigned long w;
+		for (w = b->marks.data[i]; w; w &= w - 1) ++n;
+	}
+#endif
+	return n;
+}
+
+/* first marked line from y in direction dir (1 or -1), -1 if none */
+static ssize_t
+markNext(Buffer *b, ssize_t y, int dir)
+{
+	size_t w;
+	unsigned long bits;
+	if (y < 0) return -1;
+	if ((size_t)y / MARKBITS >= b->marks.len) {
+		if (dir > 0 || !b->marks.len) return -1;
+		y = (ssize_t)(b->marks.len * MARKBITS - 1);
+	}
+	w = (size_t)y / MARKBITS;
+	if (dir > 0) {
+		bits = b->marks.data[w] & (~0UL << ((size_t)y % MARKBITS));
+		while (!bits && ++w < b->marks.len)
+			bits = b->marks.data[w];
+		if (!bits) return -1;
+#ifdef __GNUC__
+		return (ssize_t)(w * MARKBITS + (size_t)__builtin_ctzl(bits));
+#else
+		for (y = 0; !(bits >> y & 1); ++y);
+		return (ssize_t)(w * MARKBITS) + y;
+#endif
+	}
+	bits = b->marks.data[w] & (~0UL >> (MARKBITS - 1 - (size_t)y % MARKBITS));
+	while (!bits && w--)
+		bits = b->marks.data[w];
+	if (!bits) return -1;
+#ifdef __GNUC__
+	return (ssize_t)(w * MARKBITS + MARKBITS - 1 - (size_t)__builtin_clzl(bits));
+#else
+	for (y = (ssize_t)MARKBITS - 1; !(bits >> y & 1); --y);
+	return (ssize_t)(w * MARKBITS) + y;
+#endif
+}
+
+/* MARKBITS bits starting at bit pos */
+static unsigned long
+marksWord(Buffer *b, size_t pos)
+{
+	size_t w = pos / MARKBITS, o = pos % MARKBITS;
+	unsigned long lo, hi;
+	lo = w < b->marks.len ? b->marks.data[w] : 0;
+	if (!o) return lo;
+	hi = w + 1 < b->marks.len ? b->marks.data[w + 1] : 0;
+	return (lo >> o) | (hi << (MARKBITS - o));
+}
+
+static void
+marksTrim(Buffer *b)
+{
+	while (b->marks.len && !b->marks.data[b->marks.len - 1])
+		--(b->marks.len);
+}
+
+/* shifts marks of lines >= at by n up, leaving n unmarked lines at at */
+static void
+marksInsert(Buffer *b, size_t at, size_t n)
+{
+	size_t w, w0, start, oldlen;
+	unsigned long keep, shifted, shiftmask;
+	if (!n || at >= b->marks.len * MARKBITS) return;
+	oldlen = b->marks.len;
+	b->marks.data = realloc(b->marks.data, (b->marks.len +=
+				(n + MARKBITS - 1) / MARKBITS) * sizeof *(b->marks.data));
+	memset(b->marks.data + oldlen, 0,
+			(b->marks.len - oldlen) * sizeof *(b->marks.data));
+	/* going down, so every read word is still unmodified */
+	for (w0 = at / MARKBITS, w = b->marks.len; w-- > w0; ) {
+		start = w * MARKBITS;
+		if (start >= n)
+			shifted = marksWord(b, start - n);
+		else
+			shifted = n - start < MARKBITS ? marksWord(b, 0) << (n - start) : 0;
+		keep = at >= start + MARKBITS ? ~0UL :
+			at <= start ? 0 : ~0UL >> (MARKBITS - (at - start));
+		shiftmask = at + n <= start ? ~0UL :
+			at + n >= start + MARKBITS ? 0 : ~0UL << (at + n - start);
+		b->marks.data[w] = (b->marks.data[w] & keep) | (shifted & shiftmask);
+	}
+	marksTrim(b);
+}
+
+/* drops marks of lines [at, at + n), shifting the rest down */
+static void
+marksDelete(Buffer *b, size_t at, size_t n)
+{
+	size_t w, o;
+	unsigned long keep;
+	if (!n || at >= b->marks.len * MARKBITS) return;
+	/* going up, so every read word is at or above the written one */
+	w = at / MARKBITS; o = at % MARKBITS;
+	keep = o ? ~0UL >> (MARKBITS - o) : 0;
+	b->marks.data[w] = (b->marks.data[w] & keep) | (marksWord(b, at + n) << o);
+	for (++w; w < b->marks.len; ++w)
+		b->marks.data[w] = marksWord(b, w * MARKBITS + n);
+	marksTrim(b);
+}
+
+/* makes room for n lines before line at, with one memmove;
+   new lines are left for the caller to fill */
+static Line *
+linesInsert(Buffer *b, size_t at, size_t n)
+{
+	if (!n) return b->lines.data + at;
+	b->lines.data = realloc(b->lines.data,
+			(b->lines.len + n) * sizeof *(b->lines.data));
+	memmove(b->lines.data + at + n, b->lines.data + at,
+			(b->lines.len - at) * sizeof *(b->lines.data));
+	b->lines.len += n;
+	marksInsert(b, at, n);
+	bufShift(b, at, at + n);
+	return b->lines.data + at;
+}
+
+/* removes n lines starting at line at, with one memmove;
+   buffer is never left without lines */
+static void
+linesDelete(Buffer *b, size_t at, size_t n)
+{
+	size_t i;
+	if (!n) return;
+	for (i = at; i < at + n; ++i)
+		lineFree(b->lines.data + i);
+	memmove(b->lines.data + at, b->lines.data + at + n,
+			(b->lines.len - at - n) * sizeof *(b->lines.data));
+	marksDelete(b, at, n);
+	jnlDelete(b, at, n);
+	/* empty line left in place of all of them is new */
+	if (!(b->lines.len -= n)) {
+		pushVector(b->lines, newLine(0));
+		bufShift(b, at, 1);
+	} else {
+		bufShift(b, at, at);
+	}
+}
+
+/* removes all marked lines, compacting the array in a single pass */
+static size_t
+linesDeleteMarked(Buffer *b)
+{
+	size_t r, w, first = SIZE_MAX, end = 0;
+	for (r = w = 0; r < b->lines.len; ++r) {
+		if (markGet(b, r)) {
+			lineFree(b->lines.data + r);
+			jnlDelete(b, w, 1);
+			if (r < first) first = r;
+			end = w;
+		} else {
+			b->lines.data[w++] = b->lines.data[r];
+		}
+	}
+	b->marks.len = 0;
+	r -= w;
+	if (!(b->lines.len = w)) {
+		pushVector(b->lines, newLine(0));
+		end = 1;
+	}
+	if (r) bufShift(b, first, end);
+	return r;
+}
+
+/* inserts times copies of n lines from src before line at,
+   sharing their storage */
+static void
+linesCopy(Buffer *b, size_t at, const Line *src, size_t n, size_t times)
+{
+	Line *dst = linesInsert(b, at, n * times);
+	size_t i;
+	while (times--)
+		for (i = 0; i < n; ++i)
+			*dst++ = lineRef(src[i]);
+}
+
+/* puts times copies of lines of register r before line at; lines
+   which are still where they were yanked from in this buffer are
+   journaled as copy of them, not as their text.  Line storage is not
+   written while shared, so the same storage is the same text */
+static void
+linesSplice(Buffer *b, size_t at, const Register *r, size_t times)
+{
+	size_t i, n = r->lines.len;
+	int same = bufGet(r->buf) == b && r->y <= b->lines.len
+		&& n <= b->lines.len - r->y;
+	for (i = 0; same && i < n; ++i)
+		same = b->lines.data[r->y + i].data == r->lines.data[i].data
+			&& b->lines.data[r->y + i].len == r->lines.data[i].len;
+	linesCopy(b, at, r->lines.data, n, times);
+	if (same)
+		jnlCopy(b, at, r->y, n, times);
+	else
+		jnlLines(b, at, n * times);
+}
+
+/* puts n bytes of s in place of characters [x1, x2) of line y;
+   line whose words are indexed as it is has only words around
+   the edit counted again, and the index lets go of its storage
+   meanwhile, so it is not copied */
+static void
+charsReplace(Buffer *b, size_t y, size_t x1, size_t x2, const char *s, size_t n)
+{
+	Line *ln = b->lines.data + y, *o = NULL;
+	int synced = b->wordsepoch == b->epoch;
+
+	if (y < b->words.len && b->words.data[y].data == ln->data
+	&&  b->words.data[y].len == ln->len) {
+		o = b->words.data + y;
+		wordsAround(ln, x1, x2, -1);
+		lineFree(o);
+	}
+	if (n || x2 < ln->len) {
+		lineOwn(ln, ln->len + n);
+		memmove(ln->data + x1 + n, ln->data + x2, ln->len - x2);
+		memcpy(ln->data + x1, s, n);
+	}
+	ln->len = ln->len - (x2 - x1) + n;
+	bufTouch(b, y);
+	if (o) {
+		wordsAround(ln, x1, x1 + n, 1);
+		*o = lineRef(*ln);
+		if (synced)
+			b->wordsepoch = b->epoch;
+	}
+}
+
+/* removes characters [x1, x2) from line y */
+static void
+charsDelete(Buffer *b, size_t y, size_t x1, size_t x2)
+{
+	Line *ln = b->lines.data + y;
+	if (x2 > ln->len) x2 = ln->len;
+	if (x1 >= x2) return;
+	charsReplace(b, y, x1, x2, "", 0);
+	jnlCut(b, y, x1, x2);
+}
+
+/* inserts n bytes of s into line y before x */
+static void
+charsInsert(Buffer *b, size_t y, size_t x, const char *s, size_t n)
+{
+	if (!n) return;
+	charsReplace(b, y, x, x, s, n);
+	jnlChars(b, y, x, s, n);
+}
+
+/* sorting: keys of lines are sorted by parallel merge sort, then lines
+   are put in their order; only Line descriptors move, never text */
+static void
+sortKey(SortKey *k, const Line *l, size_t i, int flags, size_t field)
+{
+	const char *s = l->data, *end = l->data + l->len;
+	double d, frac;
+	uint64_t u;
+	int neg;
+
+	/* field is counted from 1, blanks separate fields */
+	for (; field > 1; --field) {
+		while (s < end && (*s == ' ' || *s == '\t')) ++s;
+		while (s < end && *s != ' ' && *s != '\t') ++s;
+	}
+	k->i = i;
+	k->s = s;
+	k->len = (size_t)(end - s);
+	k->pre[0] = k->pre[1] = 0;
+	if (!(flags & SortNumeric))
+		return;
+	/* first number in key, lines without one are sorted first */
+	while (s < end && !isdigit((unsigned char)*s)) ++s;
+	if (s == end)
+		return;
+	neg = s > l->data && s[-1] == '-';
+	for (d = 0; s < end && isdigit((unsigned char)*s); ++s)
+		d = d * 10 + (*s - '0');
+	if (s + 1 < end && *s == '.' && isdigit((unsigned char)s[1]))
+		for (++s, frac = 0.1; s < end && isdigit((unsigned char)*s); ++s, frac /= 10)
+			d += (*s - '0') * frac;
+	if (neg && d)
+		d = -d;
+	/* IEEE 754 doubles order as integers once sign is handled */
+	memcpy(&u, &d, sizeof u);
+	k->pre[0] = u >> 63 ? ~u : u | (uint64_t)1 << 63;
+}
+
+static void
+sortPrefix(SortKey *keys, size_t n)
+{
+	size_t i, j, cp = keys[0].len;
+	for (i = 1; i < n && cp; ++i) {
+		for (j = 0; j < cp && j < keys[i].len && keys[i].s[j] == keys[0].s[j]; ++j);
+		cp = j;
+	}
+	for (i = 0; i < n; ++i)
+		for (j = cp; j < cp + 16; ++j)
+			keys[i].pre[(j - cp) / 8] = keys[i].pre[(j - cp) / 8] << 8
+				| (j < keys[i].len ? (unsigned char)keys[i].s[j] : 0);
+}
+
+static inline int
+sortCompare(const SortKey *a, const SortKey *b, int flags)
+{
+	int r;
+	if (a->pre[0] != b->pre[0]) {
+		r = a->pre[0] < b->pre[0] ? -1 : 1;
+	} else if (a->pre[1] != b->pre[1]) {
+		r = a->pre[1] < b->pre[1] ? -1 : 1;
+	} else if (flags & SortNumeric) {
+		r = 0;
+	} else if (!(r = memcmp(a->s, b->s, a->len < b->len ? a->len : b->len))) {
+		r = (a->len > b->len) - (a->len < b->len);
+	}
+	return flags & SortReverse ? -r : r;
+}
+
+/* stable merge of sorted a and b into dst */
+static void
+sortMerge(SortKey *dst, const SortKey *a, size_t na,
+		const SortKey *b, size_t nb, int flags)
+{
+	const SortKey *aend = a + na, *bend = b + nb;
+	while (a < aend && b < bend)
+		*(dst++) = sortCompare(b, a, flags) < 0 ? *(b++) : *(a++);
+	memcpy(dst, a, (size_t)(aend - a) * sizeof *a);
+	memcpy(dst + (aend - a), b, (size_t)(bend - b) * sizeof *b);
+}
+
+/* sorts n keys of a, using tmp of the same size */
+static void
+sortRun(SortKey *a, SortKey *tmp, size_t n, int flags)
+{
+	SortKey *src = a, *dst = tmp, *t, k;
+	size_t i, j, w;
+
+	/* short runs are sorted by insertion first */
+	for (i = 0; i < n; i += SORTRUN) {
+		for (j = i + 1; j < n && j < i + SORTRUN; ++j) {
+			k = a[j];
+			for (w = j; w > i && sortCompare(&k, a + w - 1, flags) < 0; --w)
+				a[w] = a[w - 1];
+			a[w] = k;
+		}
+	}
+	for (w = SORTRUN; w < n; w *= 2) {
+		for (i = 0; i < n; i += 2 * w) {
+			if (i + w >= n)
+				memcpy(dst + i, src + i, (n - i) * sizeof *src);
+			else
+				sortMerge(dst + i, src + i, w, src + i + w,
+						i + 2 * w > n ? n - i - w : w, flags);
+		}
+		t = src; src = dst; dst = t;
+	}
+	if (src != a)
+		memcpy(a, src, n * sizeof *a);
+}
+
+static void *
+sortThread(void *p)
+{
+	SortJob *j = p;
+	if (j->mid == j->lo)
+		sortRun(j->src + j->lo, j->dst + j->lo, j->hi - j->lo, j->flags);
+	else
+		sortMerge(j->dst + j->lo, j->src + j->lo, j->mid - j->lo,
+				j->src + j->mid, j->hi - j->mid, j->flags);
+	return NULL;
+}
+
+/* runs jobs in threads, the last one in calling thread */
+static void
+sortJobs(SortJob *jobs, size_t n)
+{
+	pthread_t *t = malloc(n * sizeof *t);
+	size_t i;
+	int *started = calloc(n, sizeof *started);
+	for (i = 0; i + 1 < n; ++i)
+		started[i] = !pthread_create(t + i, NULL, sortThread, jobs + i);
+	for (i = 0; i < n; ++i)
+		if (!started[i])
+			sortThread(jobs + i);
+	for (i = 0; i + 1 < n; ++i)
+		if (started[i])
+			pthread_join(t[i], NULL);
+	free(started);
+	free(t);
+}
+
+/* sorts n keys: each thread sorts its part, then parts are merged
+   pairwise, each pair by one thread, until one is left */
+static void
+sortKeys(SortKey *keys, size_t n, int flags)
+{
+	SortKey *tmp = malloc(n * sizeof *tmp), *src = keys, *dst = tmp, *t;
+	SortJob *jobs;
+	size_t *bound, parts, i, m;
+
+	parts = n / SORTMIN;
+	if (parts > sortthreads) parts = sortthreads;
+	if (!parts) parts = 1;
+	jobs = malloc(parts * sizeof *jobs);
+	bound = malloc((parts + 1) * sizeof *bound);
+	for (i = 0; i <= parts; ++i)
+		bound[i] = n / parts * i + (i == parts ? n % parts : 0);
+	for (i = 0; i < parts; ++i)
+		jobs[i] = (SortJob){ keys, tmp, bound[i], bound[i], bound[i + 1], flags };
+	sortJobs(jobs, parts);
+
+	while (parts > 1) {
+		for (i = m = 0; i < parts; i += 2, ++m) {
+			if (i + 1 == parts)
+				jobs[m] = (SortJob){ src, dst, bound[i], bound[i + 1], bound[i + 1], flags };
+			else
+				jobs[m] = (SortJob){ src, dst, bound[i], bound[i + 1], bound[i + 2], flags };
+			bound[m] = bound[i];
+		}
+		bound[m] = n;
+		sortJobs(jobs, m);
+		parts = m;
+		t = src; src = dst; dst = t;
+	}
+	if (src != keys)
+		memcpy(keys, src, n * sizeof *keys);
+	free(bound);
+	free(jobs);
+	free(tmp);
+}
+
+/* registers */
+static Register *
+regGet(int name)
+{
+	if (name >= 'A' && name <= 'Z') name = tolower(name);
+	if (name >= 'a' && name <= 'z')
+		return be.regs + 1 + (name - 'a');
+	return be.regs;
+}
+
+static void
+regFree(Register *r)
+{
+	size_t i;
+	for (i = 0; i < r->lines.len; ++i)
+		lineFree(r->lines.data + i);
+	r->lines.len = 0;
+}
+
+/* yanking only takes references, no line data is copied */
+static void
+regYankLines(Register *r, Buffer *b, const IArg *ia)
+{
+	ssize_t y;
+	regFree(r);
+	r->linewise = 1;
+	r->buf = BUFNONE;
+	if (!ia->marked) {
+		r->buf = bufId(b);
+		r->y = (size_t)ia->l1;
+		r->lines.data = realloc(r->lines.data,
+				(size_t)(ia->l2 - ia->l1 + 1) * sizeof *(r->lines.data));
+		for (y = ia->l1; y <= ia->l2; ++y)
+			r->lines.data[r->lines.len++] = lineRef(b->lines.data[y]);
+		return;
+	}
+	r->lines.data = realloc(r->lines.data,
+			markCount(b) * sizeof *(r->lines.data));
+	for (y = rangeFirst(ia); y >= 0; y = rangeNext(ia, y))
+		r->lines.data[r->lines.len++] = lineRef(b->lines.data[y]);
+}
+
+static void
+regYankChars(Register *r, Buffer *b, size_t y, size_t x1, size_t x2)
+{
+	Line l = lineRef(b->lines.data[y]);
+	regFree(r);
+	r->linewise = 0;
+	r->buf = BUFNONE;
+	if (x2 > l.len) x2 = l.len;
+	l.data += x1;
+	l.len = x2 > x1 ? x2 - x1 : 0;
+	pushVector(r->lines, l);
+}
+
+/* writes lines of range ia (whole buffer if NULL) to fd,
+   gathering them into batches of writev calls */
+static int
+writeLines(int fd, Buffer *b, const IArg *ia)
+{
+	struct iovec iov[WRITEIOV];
+	ssize_t y, last;
+	int n;
+
+	y = ia ? rangeFirst(ia) : 0;
+	last = ia ? ia->l2 : (ssize_t)b->lines.len - 1;
+	for (n = 0; y >= 0 && y <= last; y = ia ? rangeNext(ia, y) : y + 1) {
+		iov[n].iov_base = b->lines.data[y].data;
+		iov[n++].iov_len = b->lines.data[y].len;
+		iov[n].iov_base = "\n";
+		iov[n++].iov_len = 1;
+		if (n == WRITEIOV) {
+			if (writevAll(fd, iov, n) < 0)
+				return -1;
+			n = 0;
+		}
+	}
+	return writevAll(fd, iov, n);
+}
+
+/* writes all of iov, going on after short writes and signals */
+static int
+writevAll(int fd, struct iovec *iov, int n)
+{
+	ssize_t w;
+	while (n) {
+		if ((w = writev(fd, iov, n)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		for (; n && (size_t)w >= iov->iov_len; --n, ++iov)
+			w -= (ssize_t)iov->iov_len;
+		if (n) {
+			iov->iov_base = (char *)iov->iov_base + w;
+			iov->iov_len -= (size_t)w;
+		}
+	}
+	return 0;
+}
+
+/* writes buffer, or range ia of it; its own file is not overwritten
+   if someone else changed it since it was read, unless forced */
+static int
+writeBuffer(Buffer *buf, char *filename, const IArg *ia, int force)
+{
+	int fd, exists, err = 0, own = !filename;
+	char *target, *tmp, msg[PATH_MAX + 64];
+	struct stat sb;
+
+	if (bufLoading(buf))
+		return 1;
+	/* lines of wrong index would be written; file is read again */
+	if (bufCheck(buf) < 0) {
+		snprintf(msg, sizeof msg, lang_err[ErrIndexStale], buf->name);
+		return minibufferError(msg);
+	}
+	if (filename == NULL) {
+		if (buf->anonymous)
+			return minibufferError(lang_err[ErrWriteAnon]);
+		else
+			filename = buf->path;
+		if (!force && fileChanged(filename, &(buf->sb)))
+			return minibufferError(lang_err[ErrChanged]);
+	}
+	/* lines are written beside file and renamed over it, so failed
+	   write leaves it as it was; symbolic link is written through */
+	if (!(target = realpath(filename, NULL)))
+		target = strdup(filename);
+	tmp = malloc(strlen(target) + 5);
+	sprintf(tmp, "%s%%new", target);
+	exists = stat(target, &sb) == 0;
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0755)) < 0) {
+		err = errno;
+	} else {
+		if (exists) {
+			/* only root can give file back to its owner */
+			if (fchown(fd, sb.st_uid, sb.st_gid) < 0)
+				errno = 0;
+			fchmod(fd, sb.st_mode & 07777);
+		}
+		if (writeLines(fd, buf, ia) < 0 || fstat(fd, &sb) < 0)
+			err = errno;
+		if (close(fd) < 0 && !err)
+			err = errno;
+		if (!err && rename(tmp, target) < 0)
+			err = errno;
+		if (err)
+			unlink(tmp);
+	}
+	free(tmp);
+	free(target);
+	if (err)
+		return minibufferError(strerror(err));
+	/* else appended lines would be read from its beginning again */
+	if (own && buf->follow)
+		followReopen(buf->follow, &sb);
+	if (own && ia == NULL) {
+		buf->sb = sb;
+		buf->stale = 0;
+		jnlEnd(buf);
+		indexWrite(filename, &(buf->sb), &(buf->lines));
+	}
+	if (ia == NULL)
+		buf->dirty = 0;
+	return 0;
+}
+
+static int
+minibufferPrint(const char *s)
+{
+	String ab = { NULL, 0 };
+	char cp[20];
+
+	abPrintf(&ab, cp, 20, "\033[%4d;%4dH\033[0m\033[K",
+			be.r, 1);
+
+	abAppend(&ab, s, strlen(s));
+
+	abAppend(&ab, "\033[0m", 4);
+
+	if ((unsigned)write(STDOUT_FILENO, ab.data, ab.len) != ab.len)
+		die("write:");
+
+	abFree(&ab);
+	return 0;
+}
+
+static int
+minibufferError(const char *s)
+{
+	String ab = { NULL, 0 };
 	char cp[23];
 
+	be.failed = 1;
+
 	abPrintf(&ab, cp, 23, "\033[%4d;%4dH\033[0;31m\033[K",
 			be.r, 1);
 
@@ -583,6 +5095,15 @@ minibufferError(const char *s)
 	return 1;
 }
 
+/* failed motion stops macro replay */
+static void
+motionFail(const char *s)
+{
+	be.failed = 1;
+	if (!be.replaying)
+		minibufferPrint(s);
+}
+
 static inline int
 submodePush(Buffer *b, Mode m)
 {
@@ -601,32 +5122,296 @@ submodePop(Buffer *b)
 	return 0;
 }
 
-/* other */
+/* commands */
+static int
+cmdIndexCompare(const void *a, const void *b)
+{
+	return Strorder(((const CmdIndex *)a)->name, ((const CmdIndex *)b)->name);
+}
+
 static void
-setup(char *filename)
+cmdIndexBuild(void)
 {
-	Buffer b;
-	Window w;
+	size_t i;
+	for (cmdindexlen = i = 0; i < LEN(commands); ++i) {
+		cmdindex[cmdindexlen].name = toString(commands[i].cmd);
+		cmdindex[cmdindexlen++].cmd = commands + i;
+		if (commands[i].alias == NULL || !strcmp(commands[i].alias, commands[i].cmd))
+			continue;
+		cmdindex[cmdindexlen].name = toString(commands[i].alias);
+		cmdindex[cmdindexlen++].cmd = commands + i;
+	}
+	qsort(cmdindex, cmdindexlen, sizeof *cmdindex, cmdIndexCompare);
+}
+
+static const Command *
+cmdLookup(String name)
+{
+	size_t lo, hi, mid;
+	int r;
+	for (lo = 0, hi = cmdindexlen; lo < hi; ) {
+		mid = lo + (hi - lo) / 2;
+		if (!(r = Strorder(name, cmdindex[mid].name)))
+			return cmdindex[mid].cmd;
+		else if (r < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return NULL;
+}
+
+/* parses single address (".", "$", "N", "N%" (line N percent of bytes
+   into buffer), "'<", "'>", with optional "+N"/"-N" offsets)
+   returns 1 if address was parsed, 0 if there was none, -1 on error */
+static int
+cmdParseAddr(String *s, ssize_t *out)
+{
+	int got = 0, sign;
+	ssize_t n;
+	size_t off, x;
+
+	if (s->len && *(s->data) == '.') {
+		*out = CURBUF.y; got = 1;
+		++(s->data); --(s->len);
+	} else if (s->len > 1 && *(s->data) == '\''
+			&& (s->data[1] == '<' || s->data[1] == '>')) {
+		/* first/last marked line */
+		if ((*out = s->data[1] == '<' ? markNext(&CURBUF, 0, 1) :
+				markNext(&CURBUF, (ssize_t)CURBUF.lines.len - 1, -1)) < 0)
+			return -1;
+		got = 1;
+		s->data += 2; s->len -= 2;
+	} else if (s->len && *(s->data) == '$') {
+		*out = (ssize_t)CURBUF.lines.len - 1; got = 1;
+		++(s->data); --(s->len);
+	} else if (s->len && isdigit((unsigned char)*(s->data))) {
+		for (n = 0; s->len && isdigit((unsigned char)*(s->data)); ++(s->data), --(s->len))
+			n = n * 10 + (*(s->data) - '0');
+		*out = n - 1; got = 1;
+		if (s->len && *(s->data) == '%') {
+			++(s->data); --(s->len);
+			if (n > 100)
+				return -1;
+			off = bytesBefore(&CURBUF, CURBUF.lines.len) * (size_t)n / 100;
+			*out = bytesLine(&CURBUF, off ? off - 1 : 0, &x);
+		}
+	}
+	while (s->len && (*(s->data) == '+' || *(s->data) == '-')) {
+		if (!got) *out = CURBUF.y;
+		got = 1;
+		sign = *(s->data) == '-' ? -1 : 1;
+		++(s->data); --(s->len);
+		if (!s->len || !isdigit((unsigned char)*(s->data))) {
+			*out += sign;
+			continue;
+		}
+		for (n = 0; s->len && isdigit((unsigned char)*(s->data)); ++(s->data), --(s->len))
+			n = n * 10 + (*(s->data) - '0');
+		*out += sign * n;
+	}
+	if (got && (*out < 0 || *out >= (ssize_t)CURBUF.lines.len))
+		return -1;
+	return got;
+}
+
+/* parses "[addr][,addr]", "%" or "*" (marked lines) prefix
+   of command line into ia */
+static int
+cmdParseRange(String *s, IArg *ia)
+{
+	int r;
+	ssize_t t;
+
+	ia->l1 = ia->l2 = CURBUF.y;
+	ia->addrs = ia->marked = 0;
+	if (s->len && *(s->data) == '*') {
+		++(s->data); --(s->len);
+		ia->l1 = 0;
+		ia->l2 = (ssize_t)CURBUF.lines.len - 1;
+		ia->addrs = 2;
+		ia->marked = 1;
+		return 0;
+	}
+	if (s->len && *(s->data) == '%') {
+		++(s->data); --(s->len);
+		ia->l1 = 0;
+		ia->l2 = (ssize_t)CURBUF.lines.len - 1;
+		ia->addrs = 2;
+		return 0;
+	}
+	if ((r = cmdParseAddr(s, &(ia->l1))) < 0)
+		return -1;
+	ia->l2 = ia->l1;
+	ia->addrs = r;
+	if (s->len && (*(s->data) == ',' || *(s->data) == ';')) {
+		++(s->data); --(s->len);
+		if (!r) ia->l1 = CURBUF.y;
+		if ((r = cmdParseAddr(s, &(ia->l2))) < 0)
+			return -1;
+		if (!r) ia->l2 = (ssize_t)CURBUF.lines.len - 1;
+		ia->addrs = 2;
+	}
+	if (ia->l1 > ia->l2) {
+		t = ia->l1; ia->l1 = ia->l2; ia->l2 = t;
+	}
+	return 0;
+}
+
+/* parses optional register name argument of "[range]cmd x" */
+static int
+cmdParseRegister(IArg *ia)
+{
+	String s = ia->S, arg;
+	if (Strarg(&s, &arg) <= 0 || isdigit((unsigned char)*(arg.data)))
+		return 0;
+	if (arg.len != 1 || !isalpha((unsigned char)*(arg.data)))
+		return -1;
+	be.reg = *(arg.data);
+	ia->S = s;
+	return 0;
+}
+
+/* parses optional count argument of "[range]cmd N",
+   which makes range N lines starting at its last line */
+static int
+cmdParseCount(IArg *ia)
+{
+	String arg;
+	size_t i, n;
+	if (Strarg(&(ia->S), &arg) <= 0)
+		return 0;
+	for (i = n = 0; i < arg.len; ++i) {
+		if (!isdigit((unsigned char)arg.data[i]))
+			return -1;
+		n = n * 10 + (size_t)(arg.data[i] - '0');
+	}
+	if (!n || ia->marked)
+		return -1;
+	ia->l1 = ia->l2;
+	ia->l2 = MIN(ia->l1 + (ssize_t)n - 1, (ssize_t)CURBUF.lines.len - 1);
+	return 0;
+}
+
+/* iteration over lines of command range */
+static ssize_t
+rangeFirst(const IArg *ia)
+{
+	ssize_t y;
+	if (!ia->marked)
+		return ia->l1;
+	y = markNext(&CURBUF, ia->l1, 1);
+	return y > ia->l2 ? -1 : y;
+}
+
+static ssize_t
+rangeNext(const IArg *ia, ssize_t y)
+{
+	if (!ia->marked)
+		return y < ia->l2 ? y + 1 : -1;
+	y = markNext(&CURBUF, y + 1, 1);
+	return y > ia->l2 ? -1 : y;
+}
+
+/* other */
+static void
+setup(char **files, size_t n)
+{
+	Slot fb;
+	struct sigaction sa;
+	size_t i;
+	int in = -1, tty;
+	char *f;
+
+	/* file "-" is standard input, which is read in background,
+	   so keys are read from terminal instead */
+	for (i = 0; i < n; ++i) {
+		if (strcmp(files[i], "-"))
+			continue;
+		if (in >= 0 || isatty(STDIN_FILENO))
+			usage();
+		if ((in = dup(STDIN_FILENO)) < 0 || (tty = open("/dev/tty", O_RDWR)) < 0)
+			die("/dev/tty:");
+		dup2(tty, STDIN_FILENO);
+		close(tty);
+		/* it is edited first */
+		f = files[i];
+		memmove(files + 1, files, i * sizeof *files);
+		files[0] = f;
+	}
 	rawOn();
-	getws(&(be.r), &(be.c));
+	if (getws(&(be.r), &(be.c)) < 0)
+		die(lang_err[ErrScreenTooSmall], 20, 3);
 
 	newVector(be.buffers);
-	/* pushing fallback buffer used when no buffers left */
-	memset(&b, 0, sizeof b);
-	pushVector(be.buffers, b);
+	/* pushing fallback buffer used when no buffers left; it has a
+	   line, as keys of replayed macro may still be run on it */
+	memset(&fb, 0, sizeof fb);
+	fb.b = createBuffer();
+	pushVector(fb.b.lines, newLine(0));
+	fb.live = 1;
+	pushVector(be.buffers, fb);
+	be.buffers.free = be.buffers.count = 0;
 
 	newVector(be.windows);
-	w.r = be.r - 1; w.c = be.c;
-	w.x = w.y = 0;
-	w.buffer = 1;
-	pushVector(be.windows, w);
+	be.layout = layoutLeaf(winNew(BUFID(0, 0)), NULL);
+	layoutApply(be.layout, 0, 0, be.r - 1, be.c);
 	be.focusedwin = 0;
 	be.cmd.data = malloc(be.cmd.len = 0);
+	newVector(be.watches);
+	cmdIndexBuild();
+	signal(SIGPIPE, SIG_IGN);
+	if (pipe(be.winch) < 0)
+		die("pipe:");
+	fcntl(be.winch[0], F_SETFL, O_NONBLOCK);
+	fcntl(be.winch[1], F_SETFL, O_NONBLOCK);
+	watchAdd(be.winch[0], winchDone, NULL);
+	be.jnldir = userDir("XDG_STATE_HOME", ".local/state");
+	pthread_mutex_init(&be.words.lock, NULL);
+	newVector(be.words.nodes);
+	pushVector(be.words.nodes, ((WordNode){ { 0, 0, 0 }, 0, 0 }));
+	if (pipe(be.words.pipe) < 0)
+		die("pipe:");
+	fcntl(be.words.pipe[0], F_SETFL, O_NONBLOCK);
+	watchAdd(be.words.pipe[0], wordsDone, NULL);
+	be.completion.buf = BUFNONE;
+	newVector(be.completion.cands);
+	if (pipe(be.tags.pipe) < 0)
+		die("pipe:");
+	fcntl(be.tags.pipe[0], F_SETFL, O_NONBLOCK);
+	watchAdd(be.tags.pipe[0], tagDone, NULL);
+	newVector(be.tags.dir);
+	newVector(be.tags.files);
+	be.idxdir = userDir("XDG_CACHE_HOME", ".cache");
+	sa.sa_handler = winchSignal;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGWINCH, &sa, NULL);
+	be.pagesize = (uintptr_t)sysconf(_SC_PAGESIZE);
+	if ((be.zero = open("/dev/zero", O_RDONLY | O_CLOEXEC)) >= 0) {
+		sa.sa_sigaction = busSignal;
+		sa.sa_flags = SA_SIGINFO;
+		sigaction(SIGBUS, &sa, NULL);
+	}
+	be.reload = BUFNONE;
+#ifdef __linux__
+	if ((be.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) >= 0)
+		watchAdd(be.inotify, fileEvents, NULL);
+#else
+	be.inotify = -1;
+#endif
 
-	if (filename == NULL)
+	/* first file is ready to edit at once, others are read meanwhile */
+	if (!n) {
 		newBuffer();
-	else
-		editBuffer(filename);
+	} else {
+		if (in >= 0)
+			stdinStart(in);
+		else if (editBuffer(files[0]) == BUFNONE)
+			die("%s:", files[0]);
+		loaderStart(files + 1, n - 1);
+	}
+	CURBUFID = bufStep(CURBUFID, 1);
 	minibufferPrint(lang_base[ErrDirty]);
 }
 
@@ -641,7 +5426,7 @@ finish(void)
 static void
 usage(void)
 {
-	die("%s: %s [-hLv] [FILE]", lang_err[ErrUsage], argv0);
+	die("%s: %s [-hLv] [FILE...]", lang_err[ErrUsage], argv0);
 }
 
 /* editor functions */
@@ -668,8 +5453,10 @@ static void
 insertmode(const Arg *arg)
 {
 	Arg a = {.i = 0};
+	if (bufLoading(&CURBUF))
+		return;
 	if (arg->i)
-		beginning(&a);
+		beginning(&a, &nulliarg);
 	switchmode(ModeEdit);
 }
 
@@ -677,9 +5464,11 @@ static void
 appendmode(const Arg *arg)
 {
 	Arg a = {.i = 0};
+	if (bufLoading(&CURBUF))
+		return;
 	++CURBUF.x;
 	if (arg->i)
-		ending(&a);
+		ending(&a, &nulliarg);
 	if (CURBUF.x > (signed)CURBUF.lines.data[CURBUF.y].len)
 		CURBUF.x = (signed)CURBUF.lines.data[CURBUF.y].len;
 	switchmode(ModeEdit);
@@ -689,301 +5478,1273 @@ static void
 replacemode(const Arg *arg)
 {
 	(void)arg;
-	switchmode(ModeReplace);
+	if (bufLoading(&CURBUF))
+		return;
+	switchmode(ModeReplace);
+}
+
+static void
+globalsubmode(const Arg *arg)
+{
+	(void)arg;
+	submodePush(&CURBUF, SubModeGlobal);
+	editorParseKey(editorGetKey());
+	submodePop(&CURBUF); /* SubModeGlobal */
+}
+
+static void
+buffermode(const Arg *arg)
+{
+	BufId id = CURBUFID;
+	Buffer *b;
+	(void)arg;
+	switchmode(ModeBuffer);
+	editorParseKey(editorGetKey());
+	/* key could close or switch buffer */
+	if ((b = bufGet(id)))
+		b->mode = ModeNormal;
+}
+
+static void
+commandmode(const Arg *arg)
+{
+	(void)arg;
+	switchmode(ModeCommand);
+}
+
+static void
+countprefix(const Arg *arg, const IArg *iarg)
+{
+	if (!arg->i && !be.count) {
+		beginning(&nullarg, &nulliarg);
+		return;
+	}
+	be.count = be.count * 10 + (size_t)arg->i;
+	(void)iarg;
+}
+
+static void
+cursormove(const Arg *arg, const IArg *iarg)
+{
+	ssize_t n = (ssize_t)COUNT(iarg);
+	switch (arg->i) {
+	case 0: /* left */
+		if (CURBUF.x > 0) CURBUF.x = MAX(0, CURBUF.x - n);
+		else motionFail(lang_info[InfoAlreadyBeg]);; break;
+	/* vertical motions are linewise even when they cannot move,
+	   so dj on the last line deletes it */
+	case 1: /* down */
+		if (CURBUF.y < (signed)CURBUF.lines.len - 1)
+			CURBUF.y = MIN(CURBUF.y + n, (signed)CURBUF.lines.len - 1);
+		else motionFail(lang_info[InfoAlreadyBot]);
+		be.motion = MotionLinewise;
+		break;
+	case 2: /* up */
+		if (CURBUF.y > 0) CURBUF.y = MAX(0, CURBUF.y - n);
+		else motionFail(lang_info[InfoAlreadyTop]);
+		be.motion = MotionLinewise;
+		break;
+	case 3: /* right */
+		if (CURBUF.x < (signed)CURBUF.lines.data[CURBUF.y].len)
+			CURBUF.x = MIN(CURBUF.x + n, (signed)CURBUF.lines.data[CURBUF.y].len);
+		else motionFail(lang_info[InfoAlreadyEnd]);; break;
+	}
+	if (CURBUF.x >= (signed)CURBUF.lines.data[CURBUF.y].len)
+		CURBUF.x = (signed)CURBUF.lines.data[CURBUF.y].len;
+}
+
+static void
+beginning(const Arg *arg, const IArg *iarg)
+{
+	if (!arg->i) CURBUF.x = 0;
+	else if (iarg->n) CURBUF.y = MIN(iarg->n - 1, CURBUF.lines.len - 1);
+	else CURBUF.y = 0;
+	if (arg->i)
+		be.motion = MotionLinewise;
+	if (CURBUF.x > (signed)CURBUF.lines.data[CURBUF.y].len)
+		CURBUF.x = (signed)CURBUF.lines.data[CURBUF.y].len;
+}
+
+static void
+ending(const Arg *arg, const IArg *iarg)
+{
+	if (!arg->i) {
+		CURBUF.x = MAX(0, (signed)CURBUF.lines.data[CURBUF.y].len);
+		be.motion = MotionInclusive;
+	} else {
+		CURBUF.y = iarg->n ? (ssize_t)MIN(iarg->n - 1, CURBUF.lines.len - 1)
+			: MAX(0, (ssize_t)CURBUF.lines.len - 1);
+		be.motion = MotionLinewise;
+	}
+	if (CURBUF.x > (signed)CURBUF.lines.data[CURBUF.y].len)
+		CURBUF.x = (signed)CURBUF.lines.data[CURBUF.y].len;
+}
+
+static void
+findchar(const Arg *arg, const IArg *iarg)
+{
+	unsigned char ch = editorGetKey();
+	Line *ln = &(CURBUF.lines.data[CURBUF.y]);
+	size_t n = COUNT(iarg);
+	ssize_t i, x = CURBUF.x;
+	if (arg->i % 2) for (i = CURBUF.x - 1; i >= 0; --i) {
+		if (ln->data[i] == ch && !--n) {
+			CURBUF.x = i + (arg->i / 2);
+			be.motion = MotionExclusive;
+			break;
+		}
+	} else for (i = CURBUF.x + 1; i < (signed)ln->len; ++i) {
+		if (ln->data[i] == ch && !--n) {
+			CURBUF.x = i - (arg->i / 2) ;
+			be.motion = MotionInclusive;
+			break;
+		}
+	}
+	if (x == CURBUF.x)
+		be.failed = 1;
+}
+
+static void
+insertchar(const Arg *arg, const IArg *iarg)
+{
+	(void)arg;
+	charsInsert(&CURBUF, (size_t)CURBUF.y, (size_t)CURBUF.x, &(iarg->c), 1);
+	++CURBUF.x;
+}
+
+static void
+replacechar(const Arg *arg, const IArg *iarg)
+{
+	Line *ln = CURBUF.lines.data + CURBUF.y;
+	(void)arg;
+	/* replacing past the end of line appends */
+	if (CURBUF.x >= (signed)ln->len) {
+		insertchar(arg, iarg);
+		return;
+	}
+	charsReplace(&CURBUF, (size_t)CURBUF.y, (size_t)CURBUF.x,
+	             (size_t)CURBUF.x + 1, &(iarg->c), 1);
+	jnlCut(&CURBUF, (size_t)CURBUF.y, (size_t)CURBUF.x, (size_t)CURBUF.x + 1);
+	jnlChars(&CURBUF, (size_t)CURBUF.y, (size_t)CURBUF.x, &(iarg->c), 1);
+	++CURBUF.x;
+}
+
+/* completes word before cursor with words of all buffers, next
+   (arg->i > 0) or previous one in order; repeated right after the word
+   it put, it goes on through them and back to the typed word */
+static void
+complete(const Arg *arg, const IArg *iarg)
+{
+	Line *ln = CURBUF.lines.data + CURBUF.y;
+	size_t x = (size_t)CURBUF.x, s, n, i;
+	char w[WORDMAX], msg[64], *cand;
+	uint32_t t;
+	(void)iarg;
+
+	cand = be.completion.cands.len ?
+		be.completion.cands.data[be.completion.i] : NULL;
+	if (be.completion.buf != CURBUFID || be.completion.y != CURBUF.y
+	||  be.completion.x + be.completion.len != x
+	||  memcmp(ln->data + be.completion.x, cand, be.completion.len)) {
+		for (s = x; s && Striden((String){ ln->data + s - 1, 1 }).len; --s);
+		if (s == x || x - s > WORDMAX) {
+			motionFail(lang_info[InfoNoCompletion]);
+			return;
+		}
+		for (i = 0; i < be.completion.cands.len; ++i)
+			free(be.completion.cands.data[i]);
+		be.completion.cands.len = 0;
+		be.completion.buf = BUFNONE;
+		memcpy(w, ln->data + s, x - s);
+		wordsSyncAll();
+		pthread_mutex_lock(&be.words.lock);
+		if ((t = wordFind(w, x - s, 0)))
+			wordsCollect(be.words.nodes.data[t].next[1], w, x - s);
+		pthread_mutex_unlock(&be.words.lock);
+		if (!be.completion.cands.len) {
+			motionFail(lang_info[InfoNoCompletion]);
+			return;
+		}
+		pushVector(be.completion.cands, strndup(ln->data + s, x - s));
+		be.completion.buf = CURBUFID;
+		be.completion.y = CURBUF.y;
+		be.completion.x = s;
+		be.completion.len = x - s;
+		be.completion.i = be.completion.cands.len - 1;
+	}
+	n = be.completion.cands.len;
+	i = be.completion.i = (be.completion.i + n + (arg->i > 0 ? 1 : n - 1)) % n;
+	cand = be.completion.cands.data[i];
+	charsDelete(&CURBUF, (size_t)CURBUF.y, be.completion.x, x);
+	charsInsert(&CURBUF, (size_t)CURBUF.y, be.completion.x, cand, strlen(cand));
+	be.completion.len = strlen(cand);
+	CURBUF.x = (ssize_t)(be.completion.x + be.completion.len);
+	if (i == n - 1) {
+		minibufferPrint(lang_info[InfoCompleteBack]);
+	} else {
+		snprintf(msg, sizeof msg, lang_info[InfoComplete],
+				(unsigned long)i + 1, (unsigned long)n - 1);
+		minibufferPrint(msg);
+	}
+}
+
+static void
+removechar(const Arg *arg)
+{
+	(void)arg;
+	if (CURBUF.x <= 0) return;
+	charsDelete(&CURBUF, (size_t)CURBUF.y, (size_t)CURBUF.x - 1, (size_t)CURBUF.x);
+	--CURBUF.x;
+}
+
+static void
+openline(const Arg *arg, const IArg *iarg)
+{
+	size_t i, n = COUNT(iarg);
+	Line *ln;
+	if (bufLoading(&CURBUF))
+		return;
+	if (arg->i != 1) ++CURBUF.y;
+	ln = linesInsert(&CURBUF, (size_t)CURBUF.y, n);
+	for (i = 0; i < n; ++i)
+		ln[i] = newLine(0);
+	if (arg->i == 2) {
+		/* rest of the split line goes to the last opened one,
+		   sharing its storage */
+		lineFree(ln + n - 1);
+		ln[n - 1] = lineRef(ln[-1]);
+		ln[n - 1].data += CURBUF.x;
+		ln[n - 1].len -= (size_t)CURBUF.x;
+		ln[-1].len = (size_t)CURBUF.x;
+		bufTouch(&CURBUF, (size_t)CURBUF.y - 1);
+	}
+	jnlLines(&CURBUF, (size_t)CURBUF.y, n);
+	if (arg->i == 2)
+		jnlLine(&CURBUF, (size_t)CURBUF.y - 1);
+	CURBUF.x = 0;
+	switchmode(ModeEdit);
+}
+
+static void
+deletelinecontent(const Arg *arg)
+{
+	size_t len = CURBUF.lines.data[CURBUF.y].len;
+	if (arg->i > 0)
+		CURBUF.lines.data[CURBUF.y].len = (size_t)arg->i;
+	else if (arg->i < 0)
+		CURBUF.lines.data[CURBUF.y].len = (unsigned)CURBUF.x;
+	else
+		CURBUF.x = (unsigned)(CURBUF.lines.data[CURBUF.y].len = 0);
+	bufTouch(&CURBUF, (size_t)CURBUF.y);
+	jnlCut(&CURBUF, (size_t)CURBUF.y, CURBUF.lines.data[CURBUF.y].len, len);
+}
+
+static void
+deleteline(const Arg *arg, const IArg *iarg)
+{
+	size_t n = UMIN(COUNT(iarg), CURBUF.lines.len - (size_t)CURBUF.y);
+	if (bufLoading(&CURBUF))
+		return;
+	if (arg->i < 0) {
+		/* D: rest of the line and count - 1 following lines */
+		deletelinecontent(arg);
+		linesDelete(&CURBUF, (size_t)CURBUF.y + 1, n - 1);
+		return;
+	}
+	linesDelete(&CURBUF, (size_t)CURBUF.y, n);
+	if (CURBUF.y >= (signed)CURBUF.lines.len)
+		CURBUF.y = (signed)CURBUF.lines.len - 1;
+	if (CURBUF.x > (signed)CURBUF.lines.data[CURBUF.y].len)
+		CURBUF.x = (signed)CURBUF.lines.data[CURBUF.y].len;
+}
+
+static void
+changeline(const Arg *arg, const IArg *iarg)
+{
+	size_t n = UMIN(COUNT(iarg), CURBUF.lines.len - (size_t)CURBUF.y);
+	if (bufLoading(&CURBUF))
+		return;
+	deletelinecontent(arg);
+	linesDelete(&CURBUF, (size_t)CURBUF.y + 1, n - 1);
+	switchmode(ModeEdit);
+}
+
+/* d{motion}, c{motion} */
+static void
+operator(const Arg *arg, const IArg *iarg)
+{
+	ssize_t sy = CURBUF.y, sx = CURBUF.x, y1, y2, x1, x2;
+	size_t n = iarg->n;
+	unsigned char key;
+	IArg ia = nulliarg;
+	Register *r = regGet(be.reg);
+
+	if (arg->i != OpYank && bufLoading(&CURBUF))
+		return;
+	/* count may be given both before and after the operator */
+	be.count = 0;
+	while (isdigit(key = editorGetKey()) && (key != '0' || be.count))
+		be.count = be.count * 10 + (size_t)(key - '0');
+	if (n || be.count)
+		be.count = (n ? n : 1) * (be.count ? be.count : 1);
+
+	be.motion = MotionNone;
+	submodePush(&CURBUF, SubModeOperator);
+	editorParseKey(key);
+	submodePop(&CURBUF); /* SubModeOperator */
+
+	if (be.motion == MotionNone)
+		be.motion = CURBUF.y != sy ? MotionLinewise :
+			CURBUF.x != sx ? MotionExclusive : MotionNone;
+	if (be.motion == MotionNone)
+		return;
+
+	if (be.motion == MotionLinewise) {
+		y1 = MIN(sy, CURBUF.y); y2 = MAX(sy, CURBUF.y);
+		ia.l1 = y1; ia.l2 = y2;
+		regYankLines(r, &CURBUF, &ia);
+		if (arg->i == OpYank) {
+			CURBUF.y = y1;
+			CURBUF.x = MIN(sx, (ssize_t)CURBUF.lines.data[CURBUF.y].len);
+		} else if (arg->i == OpChange) {
+			linesDelete(&CURBUF, (size_t)y1 + 1, (size_t)(y2 - y1));
+			CURBUF.y = y1;
+			deletelinecontent(&nullarg);
+		} else {
+			linesDelete(&CURBUF, (size_t)y1, (size_t)(y2 - y1 + 1));
+			CURBUF.y = MIN(y1, (ssize_t)CURBUF.lines.len - 1);
+			CURBUF.x = MIN(sx, (ssize_t)CURBUF.lines.data[CURBUF.y].len);
+		}
+	} else {
+		x1 = MIN(sx, CURBUF.x); x2 = MAX(sx, CURBUF.x);
+		if (be.motion == MotionInclusive) ++x2;
+		regYankChars(r, &CURBUF, (size_t)sy, (size_t)x1, (size_t)x2);
+		if (arg->i != OpYank)
+			charsDelete(&CURBUF, (size_t)sy, (size_t)x1, (size_t)x2);
+		CURBUF.y = sy;
+		CURBUF.x = x1;
+	}
+	if (arg->i == OpChange)
+		switchmode(ModeEdit);
+}
+
+/* dd, cc, yy: count lines starting with current one */
+static void
+oplinewise(const Arg *arg, const IArg *iarg)
+{
+	(void)arg;
+	CURBUF.y = MIN(CURBUF.y + (ssize_t)COUNT(iarg) - 1,
+			(ssize_t)CURBUF.lines.len - 1);
+	be.motion = MotionLinewise;
+}
+
+/* "x: next operation uses register x */
+static void
+regselect(const Arg *arg, const IArg *iarg)
+{
+	(void)arg;
+	(void)iarg;
+	be.reg = editorGetKey();
+}
+
+/* q{a-z} starts recording keys into macro, q stops it */
+static void
+macrorecord(const Arg *arg, const IArg *iarg)
+{
+	unsigned char key;
+	(void)arg;
+	(void)iarg;
+	if (be.recording) {
+		--(be.macros[be.recording - 'a'].len); /* q ending the recording */
+		be.recording = 0;
+		return;
+	}
+	if (!islower(key = editorGetKey())) {
+		minibufferError(lang_err[ErrMacroName]);
+		return;
+	}
+	be.macros[key - 'a'].len = 0;
+	be.recording = key;
+}
+
+/* [count]@{a-z}, @@ replays macro; drawing is suppressed until all
+   keys are dispatched, and replay stops on first failure */
+static void
+macroplay(const Arg *arg, const IArg *iarg)
+{
+	String saved, *m;
+	size_t i, n = COUNT(iarg);
+	unsigned char key;
+	(void)arg;
+
+	if ((key = editorGetKey()) == '@')
+		key = (unsigned char)be.lastmacro;
+	if (!islower(key) || key == be.recording) {
+		minibufferError(lang_err[ErrMacroName]);
+		return;
+	}
+	if (be.replaying >= MACRODEPTH) {
+		be.failed = 1;
+		return;
+	}
+	be.lastmacro = key;
+	m = be.macros + (key - 'a');
+	saved = be.input;
+	if (!be.replaying++)
+		be.failed = 0;
+	for (i = 0; i < n && !be.failed; ++i)
+		for (be.input = *m; be.input.len && !be.failed; )
+			editorParseKey(editorGetKey());
+	be.input = saved;
+	--be.replaying;
+}
+
+/* p, P: put register after/before cursor, count times */
+static void
+put(const Arg *arg, const IArg *iarg)
+{
+	Register *r = regGet(be.reg);
+	size_t i, n = COUNT(iarg), at;
+	Line *l;
+	if (bufLoading(&CURBUF))
+		return;
+	if (!r->lines.len) {
+		minibufferError(lang_err[ErrRegEmpty]);
+		return;
+	}
+	if (r->linewise) {
+		at = (size_t)CURBUF.y + (arg->i ? 0 : 1);
+		linesSplice(&CURBUF, at, r, n);
+		CURBUF.y = (ssize_t)at;
+		CURBUF.x = 0;
+		return;
+	}
+	l = r->lines.data;
+	at = UMIN((size_t)CURBUF.x + (arg->i ? 0 : 1), CURBUF.lines.data[CURBUF.y].len);
+	for (i = 0; i < n; ++i)
+		charsInsert(&CURBUF, (size_t)CURBUF.y, at, l->data, l->len);
+	CURBUF.x = (ssize_t)(at + n * l->len) - 1;
+	if (CURBUF.x < 0) CURBUF.x = 0;
+}
+
+static void
+togglemark(const Arg *arg, const IArg *iarg)
+{
+	size_t y, n = UMIN(COUNT(iarg), CURBUF.lines.len - (size_t)CURBUF.y);
+	(void)arg;
+	for (y = (size_t)CURBUF.y; y < (size_t)CURBUF.y + n; ++y)
+		markToggle(&CURBUF, y);
+}
+
+static void
+markjump(const Arg *arg, const IArg *iarg)
+{
+	size_t n = COUNT(iarg);
+	ssize_t y = CURBUF.y, m;
+	while (n-- && (m = markNext(&CURBUF, y + arg->i, arg->i)) >= 0)
+		y = m;
+	if (y == CURBUF.y) {
+		motionFail(lang_info[InfoNoMarks]);
+		return;
+	}
+	CURBUF.y = y;
+	if (CURBUF.x > (ssize_t)CURBUF.lines.data[CURBUF.y].len)
+		CURBUF.x = (ssize_t)CURBUF.lines.data[CURBUF.y].len;
+}
+
+static void
+execcmd(const Arg *arg)
+{
+	String name;
+	const Command *cmd;
+	IArg ia;
+	(void)arg;
+	memset(&ia, 0, sizeof ia);
+	ia.S = be.cmd;
+	be.cmd.len = 0;
+	switchmode(ModeNormal);
+
+	while (ia.S.len && isspace((unsigned char)*(ia.S.data))) {
+		++(ia.S.data); --(ia.S.len);
+	}
+	if (cmdParseRange(&(ia.S), &ia) < 0) {
+		minibufferError(lang_err[ErrRange]);
+		return;
+	}
+	while (ia.S.len && isspace((unsigned char)*(ia.S.data))) {
+		++(ia.S.data); --(ia.S.len);
+	}
+	/* command name is either a run of letters or a single symbol */
+	name.data = ia.S.data;
+	for (name.len = 0; name.len < ia.S.len
+			&& isalpha((unsigned char)name.data[name.len]); ++(name.len));
+	if (!name.len && ia.S.len)
+		name.len = 1;
+	ia.S.data += name.len;
+	ia.S.len -= name.len;
+	if (!name.len) {
+		/* bare address moves to its line */
+		if (ia.addrs) {
+			CURBUF.y = ia.l2;
+			CURBUF.x = 0;
+		}
+		return;
+	}
+	if (isalpha((unsigned char)*(name.data)) && ia.S.len && *(ia.S.data) == '!') {
+		ia.bang = 1;
+		++(ia.S.data); --(ia.S.len);
+	}
+	if ((cmd = cmdLookup(name)) == NULL) {
+		minibufferError(lang_err[ErrCmdNotFound]);
+		return;
+	}
+	(cmd->func)(&(cmd->arg), &ia);
+	be.reg = 0;
+}
+
+static void
+cmdinsertchar(const Arg *arg, const IArg *iarg)
+{
+	(void)arg;
+	be.cmd.data = realloc(be.cmd.data, ++be.cmd.len + 1);
+	memmove(be.cmd.data + be.cmd.len + 1,
+			be.cmd.data + be.cmd.len,
+			be.cmd.len - (unsigned)be.cmd.len);
+
+	be.cmd.data[be.cmd.len - 1] = iarg->c;
 }
 
 static void
-globalsubmode(const Arg *arg)
+cmdremovechar(const Arg *arg)
 {
 	(void)arg;
-	submodePush(&CURBUF, SubModeGlobal);
-	editorParseKey(editorGetKey());
-	submodePop(&CURBUF); /* SubModeGlobal */
+	if (be.cmd.len <= 0) return;
+	memmove(be.cmd.data + be.cmd.len - 1,
+			be.cmd.data + be.cmd.len,
+			be.cmd.len - (unsigned)be.cmd.len);
+	--(be.cmd.len);
 }
 
 static void
-buffermode(const Arg *arg)
+delete(const Arg *arg, const IArg *iarg)
 {
+	IArg ia = *iarg;
 	(void)arg;
-	switchmode(ModeBuffer);
-	editorParseKey(editorGetKey());
-	switchmode(ModeNormal);
+	if (bufLoading(&CURBUF))
+		return;
+	if (cmdParseRegister(&ia) < 0 || cmdParseCount(&ia) < 0) {
+		minibufferError(lang_err[ErrArgs]);
+		return;
+	}
+	regYankLines(regGet(be.reg), &CURBUF, &ia);
+	if (ia.marked)
+		linesDeleteMarked(&CURBUF);
+	else
+		linesDelete(&CURBUF, (size_t)ia.l1, (size_t)(ia.l2 - ia.l1 + 1));
+	CURBUF.y = MIN(ia.marked ? CURBUF.y : ia.l1, (ssize_t)CURBUF.lines.len - 1);
+	if (CURBUF.x > (ssize_t)CURBUF.lines.data[CURBUF.y].len)
+		CURBUF.x = (ssize_t)CURBUF.lines.data[CURBUF.y].len;
 }
 
 static void
-commandmode(const Arg *arg)
+yank(const Arg *arg, const IArg *iarg)
 {
+	IArg ia = *iarg;
 	(void)arg;
-	switchmode(ModeCommand);
+	if (cmdParseRegister(&ia) < 0 || cmdParseCount(&ia) < 0) {
+		minibufferError(lang_err[ErrArgs]);
+		return;
+	}
+	regYankLines(regGet(be.reg), &CURBUF, &ia);
 }
 
+/* :[line]pu[!] [x], linewise after the line (before it with !) */
 static void
-cursormove(const Arg *arg)
+cmdput(const Arg *arg, const IArg *iarg)
 {
-	switch (arg->i) {
-	case 0: /* left */
-		if (CURBUF.x > 0) --(CURBUF.x);
-		else minibufferPrint(lang_info[InfoAlreadyBeg]);; break;
-	case 1: /* down */
-		if (CURBUF.y < (signed)CURBUF.lines.len - 1) ++(CURBUF.y);
-		else minibufferPrint(lang_info[InfoAlreadyBot]);; break;
-	case 2: /* up */
-		if (CURBUF.y > 0) --(CURBUF.y);
-		else minibufferPrint(lang_info[InfoAlreadyTop]);; break;
-	case 3: /* right */
-		if (CURBUF.x < (signed)CURBUF.lines.data[CURBUF.y].len) ++(CURBUF.x);
-		else minibufferPrint(lang_info[InfoAlreadyEnd]);; break;
+	IArg ia = *iarg;
+	Register *r;
+	size_t at;
+	(void)arg;
+	if (bufLoading(&CURBUF))
+		return;
+	if (cmdParseRegister(&ia) < 0 || ia.marked) {
+		minibufferError(lang_err[ErrArgs]);
+		return;
 	}
-	if (CURBUF.x >= (signed)CURBUF.lines.data[CURBUF.y].len)
-		CURBUF.x = (signed)CURBUF.lines.data[CURBUF.y].len;
+	if (!(r = regGet(be.reg))->lines.len) {
+		minibufferError(lang_err[ErrRegEmpty]);
+		return;
+	}
+	at = (size_t)ia.l2 + (ia.bang ? 0 : 1);
+	linesSplice(&CURBUF, at, r, 1);
+	CURBUF.y = (ssize_t)(at + r->lines.len - 1);
+	CURBUF.x = 0;
 }
 
 static void
-beginning(const Arg *arg)
+substitute(const Arg *arg, const IArg *iarg)
 {
-	if (!arg->i) CURBUF.x = 0;
-	else CURBUF.y = 0;
+	String s = iarg->S, pat, rep;
+	regex_t re;
+	regmatch_t m[10];
+	char delim, *pats, *lns;
+	int global, eflags;
+	size_t off, i, subs;
+	ssize_t y;
+	String nl;
+	Line *ln;
+	(void)arg;
+
+	if (bufLoading(&CURBUF))
+		return;
+	if (!s.len || isalnum((unsigned char)*(s.data)) || isspace((unsigned char)*(s.data))) {
+		minibufferError(lang_err[ErrPattern]);
+		return;
+	}
+	delim = *(s.data);
+	++(s.data); --(s.len);
+	Strtok2(&s, &pat, delim);
+	Strtok2(&s, &rep, delim);
+	global = s.len && *(s.data) == 'g';
+
+	pats = strndup(pat.data, pat.len);
+	if (regcomp(&re, pats, 0)) {
+		free(pats);
+		minibufferError(lang_err[ErrPattern]);
+		return;
+	}
+	free(pats);
+
+	for (subs = 0, y = iarg->l1; y <= iarg->l2; ++y) {
+		ln = CURBUF.lines.data + y;
+		lns = strndup(ln->data, ln->len);
+		nl.data = malloc(nl.len = 0);
+		for (off = 0, eflags = 0; off <= ln->len
+				&& !regexec(&re, lns + off, LEN(m), m, eflags); ) {
+			abAppend(&nl, lns + off, (size_t)m[0].rm_so);
+			for (i = 0; i < rep.len; ++i) {
+				if (rep.data[i] == '&') {
+					abAppend(&nl, lns + off + m[0].rm_so,
+							(size_t)(m[0].rm_eo - m[0].rm_so));
+				} else if (rep.data[i] == '\\' && i + 1 < rep.len
+						&& isdigit((unsigned char)rep.data[i + 1])) {
+					++i;
+					if (m[rep.data[i] - '0'].rm_so >= 0)
+						abAppend(&nl, lns + off + m[rep.data[i] - '0'].rm_so,
+								(size_t)(m[rep.data[i] - '0'].rm_eo
+									- m[rep.data[i] - '0'].rm_so));
+				} else {
+					if (rep.data[i] == '\\' && i + 1 < rep.len) ++i;
+					abAppend(&nl, rep.data + i, 1);
+				}
+			}
+			++subs;
+			/* empty match has to move forward to avoid looping */
+			if (m[0].rm_eo == m[0].rm_so) {
+				if (off + (size_t)m[0].rm_eo < ln->len)
+					abAppend(&nl, lns + off + m[0].rm_eo, 1);
+				off += (size_t)m[0].rm_eo + 1;
+			} else {
+				off += (size_t)m[0].rm_eo;
+			}
+			eflags = REG_NOTBOL;
+			if (!global) break;
+		}
+		if (off) {
+			if (off < ln->len)
+				abAppend(&nl, lns + off, ln->len - off);
+			lineFree(ln);
+			*ln = lineDup(nl.data, nl.len);
+			bufTouch(&CURBUF, (size_t)y);
+			jnlLine(&CURBUF, (size_t)y);
+		}
+		abFree(&nl);
+		free(lns);
+	}
+	regfree(&re);
+	if (!subs) {
+		minibufferError(lang_err[ErrNoMatch]);
+		return;
+	}
+	CURBUF.y = iarg->l2;
+	if (CURBUF.x > (ssize_t)CURBUF.lines.data[CURBUF.y].len)
+		CURBUF.x = (ssize_t)CURBUF.lines.data[CURBUF.y].len;
 }
 
 static void
-ending(const Arg *arg)
+shell(const Arg *arg, const IArg *iarg)
 {
-	if (!arg->i)
-		CURBUF.x = MAX(0, (signed)CURBUF.lines.data[CURBUF.y].len);
-	else
-		CURBUF.y = MAX(0, (signed)CURBUF.lines.len - 1);
+	char *shcmd;
+	FILE *fp;
+	int status;
+	size_t skip;
+	(void)arg;
+	if ((iarg->addrs || iarg->bang) && !iarg->S.len) {
+		minibufferError(lang_err[ErrArgs]);
+		return;
+	}
+	/* :sh! runs command in background */
+	if (iarg->bang) {
+		for (skip = 0; skip < iarg->S.len
+				&& isspace((unsigned char)iarg->S.data[skip]); ++skip);
+		if (iarg->addrs)
+			minibufferError(lang_err[ErrArgs]);
+		else
+			jobStart(iarg->S.data + skip, iarg->S.len - skip);
+		return;
+	}
+	rawRestore();
+	if (iarg->S.len) {
+		shcmd = malloc(iarg->S.len + 1);
+		strncpy(shcmd, iarg->S.data, iarg->S.len)[iarg->S.len] = 0;
+	} else shcmd = "$SHELL";
+	puts("");
+	if (iarg->addrs) {
+		/* range is piped to command's standard input */
+		fflush(stdout);
+		if ((fp = popen(shcmd, "w")) == NULL)
+			status = -1;
+		else {
+			writeLines(fileno(fp), &CURBUF, iarg);
+			status = pclose(fp);
+		}
+	} else {
+		status = system(shcmd);
+	}
+	if (status)
+		printf("\"%s\" failed\n", shcmd);
+	if (iarg->S.len) free(shcmd);
+	puts(lang_info[InfoPressAnyKey]);
+	rawOn();
+	be.redraw = 1;
+	while ((read(STDIN_FILENO, &shcmd, 1)) != 1);
 }
 
+/* :[range]!cmd, range is written to command while its output is
+   read, so neither side waits for the other; output replaces range
+   unless command fails. Without range, it is :sh cmd */
 static void
-findchar(const Arg *arg)
+filter(const Arg *arg, const IArg *iarg)
 {
-	unsigned char ch = editorGetKey();
-	Line *ln = &(CURBUF.lines.data[CURBUF.y]);
-	ssize_t i;
-	if (arg->i % 2) for (i = CURBUF.x - 1; i >= 0; --i) {
-		if (ln->data[i] == ch) {
-			CURBUF.x = i + (arg->i / 2);
-			break;
+	struct iovec iov[WRITEIOV];
+	struct pollfd fds[3];
+	int in[2], out[2], status, k, killed = 0;
+	unsigned char key;
+	pid_t pid;
+	Lines res;
+	Chunk *c;
+	size_t y, off, n, len;
+	ssize_t rb;
+	char msg[128], *cmd;
+
+	if (!iarg->addrs) {
+		shell(arg, iarg);
+		return;
+	}
+	if (bufLoading(&CURBUF))
+		return;
+
+	if (iarg->marked || !iarg->S.len) {
+		minibufferError(lang_err[iarg->marked ? ErrRange : ErrArgs]);
+		return;
+	}
+	if (pipe(in) < 0 || pipe(out) < 0) {
+		minibufferError(strerror(errno));
+		return;
+	}
+	cmd = strndup(iarg->S.data, iarg->S.len);
+	if ((pid = fork()) < 0) {
+		minibufferError(strerror(errno));
+		close(in[0]); close(in[1]);
+		close(out[0]); close(out[1]);
+		free(cmd);
+		return;
+	}
+	if (!pid) {
+		setpgid(0, 0);
+		signal(SIGPIPE, SIG_DFL);
+		dup2(in[0], STDIN_FILENO);
+		dup2(out[1], STDOUT_FILENO);
+		dup2(out[1], STDERR_FILENO);
+		close(in[0]); close(in[1]);
+		close(out[0]); close(out[1]);
+		execl("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+		_exit(127);
+	}
+	setpgid(pid, pid);
+	close(in[0]);
+	close(out[1]);
+	fcntl(in[1], F_SETFL, O_NONBLOCK);
+	fcntl(out[0], F_SETFL, O_NONBLOCK);
+
+	newVector(res);
+	pushVector(res, newLine(0));
+	y = (size_t)iarg->l1;
+	off = 0; /* bytes of line y written, its newline is one more */
+	fds[0] = (struct pollfd){ in[1], POLLOUT, 0 };
+	fds[1] = (struct pollfd){ out[0], POLLIN, 0 };
+	/* signals are not made from keys, so escape or ^C stops command */
+	fds[2] = (struct pollfd){ STDIN_FILENO, POLLIN, 0 };
+	while (fds[1].fd >= 0) {
+		if (poll(fds, 3, -1) < 0) {
+			if (errno == EINTR) continue;
+			die("poll:");
 		}
-	} else for (i = CURBUF.x + 1; i < (signed)ln->len; ++i) {
-		if (ln->data[i] == ch) {
-			CURBUF.x = i - (arg->i / 2) ;
-			break;
+		if (fds[0].revents) {
+			/* lines are written from where they are stored */
+			for (n = 0, k = 0; y + n <= (size_t)iarg->l2 && k < WRITEIOV; ++n) {
+				len = CURBUF.lines.data[y + n].len;
+				if (!n && off < len)
+					iov[k++] = (struct iovec){ CURBUF.lines.data[y].data + off, len - off };
+				else if (n && len)
+					iov[k++] = (struct iovec){ CURBUF.lines.data[y + n].data, len };
+				if (k < WRITEIOV)
+					iov[k++] = (struct iovec){ "\n", 1 };
+			}
+			if ((rb = writev(in[1], iov, k)) < 0 && errno != EAGAIN) {
+				/* command does not read whole range */
+				y = (size_t)iarg->l2 + 1;
+			}
+			for (; rb > 0; ++y, off = 0) {
+				if ((size_t)rb <= CURBUF.lines.data[y].len - off) {
+					off += (size_t)rb;
+					break;
+				}
+				rb -= (ssize_t)(CURBUF.lines.data[y].len - off + 1);
+			}
+			if (y > (size_t)iarg->l2) {
+				close(in[1]);
+				fds[0].fd = -1;
+			}
+		}
+		if (fds[1].revents) {
+			c = chunkNew(JOBREAD);
+			if ((rb = read(out[0], c->data, JOBREAD)) > 0) {
+				chunkAppend(&res, chunkShrink(c, (size_t)rb), (size_t)rb);
+			} else {
+				free(c);
+				if (!rb || (errno != EAGAIN && errno != EINTR)) {
+					close(out[0]);
+					fds[1].fd = -1;
+				}
+			}
+		}
+		if (fds[2].revents) {
+			if (read(STDIN_FILENO, &key, 1) != 1)
+				fds[2].fd = -1;
+			else if (key == 0x1b || key == 0x03)
+				kill(-pid, killed++ ? SIGKILL : SIGTERM);
+		}
+	}
+	if (fds[0].fd >= 0)
+		close(in[1]);
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+
+	/* newline ending output does not start another line */
+	if (res.len > 1 && !res.data[res.len - 1].len)
+		lineFree(res.data + --res.len);
+	if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+		snprintf(msg, sizeof msg, lang_info[InfoJobDone], cmd,
+				WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+		minibufferError(msg);
+		for (n = 0; n < res.len; ++n)
+			lineFree(res.data + n);
+	} else {
+		n = (size_t)(iarg->l2 - iarg->l1 + 1);
+		if (res.len > 1 || res.data[0].len) {
+			memcpy(linesInsert(&CURBUF, (size_t)iarg->l2 + 1, res.len),
+					res.data, res.len * sizeof *(res.data));
+			jnlLines(&CURBUF, (size_t)iarg->l2 + 1, res.len);
+		} else {
+			lineFree(res.data);
 		}
+		linesDelete(&CURBUF, (size_t)iarg->l1, n);
+		CURBUF.y = iarg->l1 < (ssize_t)CURBUF.lines.len ?
+			iarg->l1 : (ssize_t)CURBUF.lines.len - 1;
+		CURBUF.x = 0;
 	}
+	free(res.data);
+	free(cmd);
 }
 
+/* :[range]sort[!] [n][r][u][k N], numeric, reverse (also with !),
+   unique and by N-th field on; without range whole buffer is sorted */
 static void
-insertchar(const Arg *arg, const IArg *iarg)
+sort(const Arg *arg, const IArg *iarg)
 {
+	Buffer *b = &CURBUF;
+	String s = iarg->S;
+	SortKey *keys;
+	Line *sorted;
+	char *marked = NULL, c;
+	size_t field = 1, at, n, i, m, last, *order;
+	int flags = iarg->bang ? SortReverse : 0;
 	(void)arg;
-	CURBUF.lines.data[CURBUF.y].data =
-		realloc(CURBUF.lines.data[CURBUF.y].data,
-				++CURBUF.lines.data[CURBUF.y].len + 1);
-	memmove(CURBUF.lines.data[CURBUF.y].data + CURBUF.x + 1,
-			CURBUF.lines.data[CURBUF.y].data + CURBUF.x,
-			CURBUF.lines.data[CURBUF.y].len - (unsigned)CURBUF.x);
-	CURBUF.dirty = 1;
+	if (bufLoading(b))
+		return;
+
+	while (s.len) {
+		c = *(s.data++); --(s.len);
+		if (c == 'n') {
+			flags |= SortNumeric;
+		} else if (c == 'r') {
+			flags |= SortReverse;
+		} else if (c == 'u') {
+			flags |= SortUnique;
+		} else if (c == 'k') {
+			for (; s.len && isspace((unsigned char)*(s.data)); ++(s.data), --(s.len));
+			for (field = 0; s.len && isdigit((unsigned char)*(s.data)); ++(s.data), --(s.len))
+				field = field * 10 + (size_t)(*(s.data) - '0');
+			if (!field) {
+				minibufferError(lang_err[ErrArgs]);
+				return;
+			}
+		} else if (!isspace((unsigned char)c)) {
+			minibufferError(lang_err[ErrArgs]);
+			return;
+		}
+	}
+	if (iarg->marked) {
+		minibufferError(lang_err[ErrRange]);
+		return;
+	}
+	at = iarg->addrs ? (size_t)iarg->l1 : 0;
+	n = iarg->addrs ? (size_t)(iarg->l2 - iarg->l1 + 1) : b->lines.len;
+	if (n < 2)
+		return;
+
+	keys = malloc(n * sizeof *keys);
+	for (i = 0; i < n; ++i)
+		sortKey(keys + i, b->lines.data + at + i, i, flags, field);
+	if (!(flags & SortNumeric))
+		sortPrefix(keys, n);
+	sortKeys(keys, n, flags);
+	if (markCount(b)) {
+		marked = malloc(n);
+		for (i = 0; i < n; ++i)
+			marked[i] = (char)markGet(b, at + i);
+	}
 
-	CURBUF.lines.data[CURBUF.y].data[CURBUF.x++] = iarg->c;
+	/* repeated lines go after kept ones, to be deleted */
+	order = malloc(n * sizeof *order);
+	for (i = m = last = 0; i < n; ++i) {
+		if ((flags & SortUnique) && i && !sortCompare(keys + last, keys + i, flags)) {
+			order[n - 1 - (i - m)] = keys[i].i;
+		} else {
+			last = i;
+			order[m++] = keys[i].i;
+		}
+	}
+	sorted = malloc(n * sizeof *sorted);
+	for (i = 0; i < n; ++i)
+		sorted[i] = b->lines.data[at + order[i]];
+	memcpy(b->lines.data + at, sorted, n * sizeof *sorted);
+	bufShift(b, at, at + n);
+	jnlOrder(b, at, n, order);
+	/* marks go with their lines */
+	for (i = 0; marked && i < n; ++i)
+		if (marked[order[i]] != markGet(b, at + i))
+			markToggle(b, at + i);
+	linesDelete(b, at + m, n - m);
+	b->y = (ssize_t)at;
+	b->x = 0;
+	free(marked);
+	free(order);
+	free(sorted);
+	free(keys);
 }
 
+/* starts or stops following file of buffer, like tail -F */
 static void
-replacechar(const Arg *arg, const IArg *iarg)
+follow(const Arg *arg)
 {
 	(void)arg;
-	if (CURBUF.x >= (signed)CURBUF.lines.data[CURBUF.y].len)
-		CURBUF.x = (signed)CURBUF.lines.data[CURBUF.y].len - 1;
-	CURBUF.dirty = 1;
-	CURBUF.lines.data[CURBUF.y].data[CURBUF.x++] = iarg->c;
+	if (CURBUF.follow) {
+		followEnd(CURBUF.follow);
+		minibufferPrint(lang_info[InfoFollowOff]);
+	} else if (CURBUF.anonymous || CURBUF.load || CURBUF.job) {
+		minibufferError(lang_err[ErrFollow]);
+	} else if (followStart(CURBUFID) < 0) {
+		minibufferError(strerror(errno));
+	} else {
+		minibufferPrint(lang_info[InfoFollowOn]);
+	}
 }
 
+/* moves to byte given as argument, counted from 1 like columns */
 static void
-removechar(const Arg *arg)
+gotobyte(const Arg *arg, const IArg *iarg)
 {
+	IArg ia = *iarg;
+	String num;
+	char *end;
+	unsigned long n;
+	size_t x;
+	ssize_t y;
 	(void)arg;
-	if (CURBUF.x <= 0) return;
-	memmove(CURBUF.lines.data[CURBUF.y].data + CURBUF.x - 1,
-			CURBUF.lines.data[CURBUF.y].data + CURBUF.x,
-			CURBUF.lines.data[CURBUF.y].len - (unsigned)CURBUF.x);
-	--(CURBUF.lines.data[CURBUF.y].len);
-	--CURBUF.x;
-}
 
-static void
-openline(const Arg *arg)
-{
-	CURBUF.lines.data = realloc(CURBUF.lines.data,
-				++(CURBUF.lines.len) * sizeof *(CURBUF.lines.data));
-	if (arg->i != 1) ++CURBUF.y;
-	memmove(CURBUF.lines.data + CURBUF.y,
-			CURBUF.lines.data + CURBUF.y - 1,
-			(CURBUF.lines.len - (unsigned)(CURBUF.y)) *
-				sizeof *(CURBUF.lines.data));
-	CURBUF.lines.data[CURBUF.y].data =
-		malloc(CURBUF.lines.data[CURBUF.y].len =
-				arg->i == 2 ? CURBUF.lines.data[CURBUF.y - 1].len -
-					(unsigned)CURBUF.x : 0);
-	if (arg->i == 2) {
-		memmove(CURBUF.lines.data[CURBUF.y].data,
-				CURBUF.lines.data[CURBUF.y - 1].data + CURBUF.x,
-				CURBUF.lines.data[CURBUF.y - 1].len - (unsigned)CURBUF.x);
-		CURBUF.lines.data[CURBUF.y - 1].len = (unsigned)CURBUF.x;
+	if (Strarg(&ia.S, &num) <= 0 || !num.len) {
+		minibufferError(lang_err[ErrArgs]);
+		return;
 	}
-	CURBUF.x = 0;
-	switchmode(ModeEdit);
+	n = strtoul(num.data, &end, 10);
+	if (end != num.data + num.len || !n) {
+		minibufferError(lang_err[ErrArgs]);
+		return;
+	}
+	if ((y = bytesLine(&CURBUF, n - 1, &x)) < 0) {
+		minibufferError(lang_err[ErrOffset]);
+		return;
+	}
+	CURBUF.y = y;
+	CURBUF.x = (ssize_t)x;
 }
 
+/* moves to definition of name given as argument */
 static void
-deletelinecontent(const Arg *arg)
+tag(const Arg *arg, const IArg *iarg)
 {
-	if (arg->i > 0)
-		CURBUF.lines.data[CURBUF.y].len = (size_t)arg->i;
-	else if (arg->i < 0)
-		CURBUF.lines.data[CURBUF.y].len = (unsigned)CURBUF.x;
-	else
-		CURBUF.x = (unsigned)(CURBUF.lines.data[CURBUF.y].len = 0);
+	IArg ia = *iarg;
+	String name;
+	(void)arg;
+
+	if (Strarg(&ia.S, &name) <= 0 || !name.len) {
+		minibufferError(lang_err[ErrArgs]);
+		return;
+	}
+	tagGo(name.data, name.len);
 }
 
+/* scans C files under directory given as argument, current one if
+   none, for tags in background */
 static void
-deleteline(const Arg *arg)
+tagindex(const Arg *arg, const IArg *iarg)
 {
-	deletelinecontent(arg);
-	if (CURBUF.lines.len < 2 || arg->i < 0)
+	IArg ia = *iarg;
+	String dir;
+	TagJob *j;
+	char msg[PATH_MAX + 64];
+	(void)arg;
+
+	if (be.tags.scanning) {
+		minibufferError(lang_err[ErrTagsBusy]);
+		return;
+	}
+	if (Strarg(&ia.S, &dir) < 0) {
+		minibufferError(lang_err[ErrArgs]);
 		return;
-	free(CURBUF.lines.data[CURBUF.y].data);
-	memmove(CURBUF.lines.data + CURBUF.y,
-			CURBUF.lines.data + CURBUF.y + 1,
-			(CURBUF.lines.len - (unsigned)(CURBUF.y) - 1) *
-				sizeof *(CURBUF.lines.data));
-	--CURBUF.lines.len;
+	}
+	j = calloc(1, sizeof *j);
+	j->buf = BUFNONE;
+	j->dir = dir.len ? strndup(dir.data, dir.len) : strdup(".");
+	newVector(j->lines);
+	newVector(j->tags);
+	newVector(j->files);
+	be.tags.scanning = 1;
+	snprintf(msg, sizeof msg, lang_info[InfoTagsScan], j->dir);
+	minibufferPrint(msg);
+	tagStart(j);
 }
 
+/* moves to definition of identifier under cursor */
 static void
-changeline(const Arg *arg)
+tagjump(const Arg *arg)
 {
-	deletelinecontent(arg);
-	switchmode(ModeEdit);
+	const Line *l = CURBUF.lines.data + CURBUF.y;
+	size_t a, e;
+	(void)arg;
+
+	for (a = (size_t)CURBUF.x; a > 0 && tagIdent(l->data[a - 1]); --a);
+	for (e = (size_t)CURBUF.x; e < l->len && tagIdent(l->data[e]); ++e);
+	if (a == e) {
+		minibufferError(lang_err[ErrNoTag]);
+		return;
+	}
+	tagGo(l->data + a, e - a);
 }
 
 static void
-togglemark(const Arg *arg)
+bufwriteclose(const Arg *arg)
 {
-	CURBUF.lines.data[CURBUF.y].isMarked = !(CURBUF.lines.data[CURBUF.y].isMarked);
+	(void)arg;
+	if (CURBUF.dirty)
+		if (writeBuffer(&CURBUF, NULL, NULL, 0))
+			return;
+	bufDel(CURBUFID);
 }
 
 static void
-execcmd(const Arg *arg)
+bufwrite(const Arg *arg, const IArg *iarg)
 {
-	String token;
-	IArg ia;
-	size_t i;
-	ia.S = be.cmd;
+	String args, fname;
+	char *filename;
 	(void)arg;
-	Strtok2(&(ia.S), &token, ' ');
-	for (i = 0; i < LEN(commands); ++i) {
-		if (!Strcmpc(token, commands[i].cmd)
-		||  !Strcmpc(token, commands[i].alias)) {
-			(commands[i].func)(commands[i].arg, &(ia.S));
-			break;
-		}
+	args = iarg->S;
+	if (Strarg(&args, &fname) < 0) {
+		minibufferError(lang_err[ErrArgs]);
+		return;
 	}
-	if (i == LEN(commands)) {
-		minibufferError(lang_err[ErrCmdNotFound]);
+	if (iarg->addrs && !fname.len) {
+		minibufferError(lang_err[ErrArgs]);
+		return;
 	}
-	be.cmd.len = 0;
-	switchmode(ModeNormal);
+	filename = fname.len ? strndup(fname.data, fname.len) : NULL;
+	writeBuffer(&CURBUF, filename, iarg->addrs ? iarg : NULL, iarg->bang);
+	free(filename);
 }
 
 static void
-cmdinsertchar(const Arg *arg, const IArg *iarg)
+bufclose(const Arg *arg)
 {
 	(void)arg;
-	be.cmd.data = realloc(be.cmd.data, ++be.cmd.len + 1);
-	memmove(be.cmd.data + be.cmd.len + 1,
-			be.cmd.data + be.cmd.len,
-			be.cmd.len - (unsigned)be.cmd.len);
-
-	be.cmd.data[be.cmd.len - 1] = iarg->c;
+	if (CURBUF.dirty) {
+		minibufferError(lang_err[ErrDirty]);
+		return;
+	}
+	bufDel(CURBUFID);
 }
 
 static void
-cmdremovechar(const Arg *arg)
+bufkill(const Arg *arg)
 {
 	(void)arg;
-	if (be.cmd.len <= 0) return;
-	memmove(be.cmd.data + be.cmd.len - 1,
-			be.cmd.data + be.cmd.len,
-			be.cmd.len - (unsigned)be.cmd.len);
-	--(be.cmd.len);
+	bufDel(CURBUFID);
 }
 
 static void
-shell(const Arg *arg, const IArg *iarg)
+buflist(const Arg *arg, const IArg *iarg)
 {
-	char *shcmd;
-	rawRestore();
-	if (iarg->S.len) {
-		shcmd = malloc(iarg->S.len + 1);
-		strncpy(shcmd, iarg->S.data, iarg->S.len)[iarg->S.len] = 0;
-	} else shcmd = "$SHELL";
-	puts("");
-	if (system(shcmd))
-		printf("\"%s\" failed\n", shcmd);
-	if (iarg->S.len) free(shcmd);
-	puts(lang_info[InfoPressAnyKey]);
-	rawOn();
-	while ((read(STDIN_FILENO, &shcmd, 1)) != 1);
+	String ab = { NULL, 0 };
+	char cp[64];
+	size_t i;
+	Buffer *b;
+	(void)arg;
+	(void)iarg;
+	abAppend(&ab, "\033[0m\033[2J\033[H", 11);
+	for (i = be.buffers.data[0].next; i; i = be.buffers.data[i].next) {
+		b = &(be.buffers.data[i].b);
+		abPrintf(&ab, cp, 64, "%4lu %c%c ", i,
+				i == BUFSLOT(CURBUFID) ? '%' : ' ', b->dirty ? '+' : ' ');
+		if (b->path)
+			abAppend(&ab, b->path, strlen(b->path));
+		else
+			abAppend(&ab, "*anonymous*", 11);
+		abPrintf(&ab, cp, 64, "%s\r\n", b->load ? " (loading)" :
+				b->job ? " (running)" : b->follow ? " (following)" : "");
+	}
+	abAppend(&ab, lang_info[InfoPressAnyKey], strlen(lang_info[InfoPressAnyKey]));
+	if ((unsigned)write(STDOUT_FILENO, ab.data, ab.len) != ab.len)
+		die("write:");
+	abFree(&ab);
+	be.redraw = 1;
+	while ((read(STDIN_FILENO, cp, 1)) != 1);
 }
 
+/* switches to buffer number given as argument if arg is 0,
+   otherwise to count-th next or previous one */
 static void
-bufwriteclose(const Arg *arg)
+bufswitch(const Arg *arg, const IArg *iarg)
 {
-	(void)arg;
-	if (CURBUF.dirty)
-		if (writeBuffer(&CURBUF, NULL))
+	IArg ia = *iarg;
+	String num;
+	char *end;
+	unsigned long n;
+	BufId id = CURBUFID;
+
+	if (!arg->i) {
+		if (Strarg(&ia.S, &num) <= 0 || !num.len) {
+			minibufferError(lang_err[ErrArgs]);
+			return;
+		}
+		n = strtoul(num.data, &end, 10);
+		if (end != num.data + num.len || !n || n >= be.buffers.len
+		||  !be.buffers.data[n].live) {
+			minibufferError(lang_err[ErrNoBuffer]);
 			return;
-	freeBuffer(be.buffers.data + CURBUFINDEX);
-	memmove(be.buffers.data + CURBUFINDEX,
-			be.buffers.data + CURBUFINDEX + 1,
-			be.buffers.len-- - (size_t)(CURBUFINDEX + 1));
+		}
+		CURBUFID = BUFID(n, be.buffers.data[n].gen);
+		return;
+	}
+	for (n = COUNT(iarg); n; --n)
+		id = bufStep(id, arg->i);
+	CURBUFID = id;
 }
 
+/* splits focused window in two showing the same buffer,
+   focusing the new one */
 static void
-bufwrite(const Arg *arg)
+winsplit(const Arg *arg)
 {
-	(void)arg;
-	writeBuffer(&CURBUF, NULL);
+	Layout *n = CURWIN.node;
+	size_t i;
+
+	if (arg->i == SplitRows ? CURWIN.r < 2 * WINROWSMIN
+			: CURWIN.c < 2 * WINCOLSMIN + 1) {
+		minibufferError(lang_err[ErrWinSmall]);
+		return;
+	}
+	i = winNew(CURBUFID);
+	n->split = arg->i;
+	n->child[0] = layoutLeaf(n->win, n);
+	n->child[1] = layoutLeaf(i, n);
+	layoutApply(n, n->y, n->x, n->r, n->c);
+	winFocus(i);
 }
 
+/* closes focused window, its space goes to the neighbouring ones */
 static void
-bufclose(const Arg *arg)
+winclose(const Arg *arg)
 {
+	Layout *n = CURWIN.node, *p = n->parent, *s;
+	size_t i, w = (size_t)be.focusedwin;
 	(void)arg;
-	if (CURBUF.dirty) {
-		minibufferError(lang_err[ErrDirty]);
+
+	if (!p) {
+		minibufferError(lang_err[ErrLastWin]);
 		return;
 	}
-	freeBuffer(be.buffers.data + CURBUFINDEX);
-	memmove(be.buffers.data + CURBUFINDEX,
-			be.buffers.data + CURBUFINDEX + 1,
-			be.buffers.len-- - (size_t)(CURBUFINDEX + 1));
+	/* sibling takes place of parent */
+	s = p->child[p->child[0] == n];
+	p->split = s->split;
+	p->win = s->win;
+	p->child[0] = s->child[0];
+	p->child[1] = s->child[1];
+	if (p->split == SplitNone) {
+		be.windows.data[p->win].node = p;
+	} else {
+		p->child[0]->parent = p->child[1]->parent = p;
+	}
+	free(n);
+	free(s);
+	free(CURWIN.status);
+	free(CURWIN.statnext);
+	abFree(&CURWIN.stathead);
+	abFree(&CURWIN.stattail);
+	memmove(be.windows.data + w, be.windows.data + w + 1,
+			(--be.windows.len - w) * sizeof *(be.windows.data));
+	for (i = w; i < be.windows.len; ++i)
+		be.windows.data[i].node->win = i;
+	layoutApply(p, p->y, p->x, p->r, p->c);
+	/* focus goes to first window in space of closed one */
+	for (s = p; s->split != SplitNone; s = s->child[0]);
+	be.focusedwin = (int)s->win;
+	winRestore(&CURWIN);
 }
 
+/* focuses next (arg->i > 0) or previous window */
 static void
-bufkill(const Arg *arg)
+winnext(const Arg *arg, const IArg *iarg)
 {
-	(void)arg;
-	freeBuffer(be.buffers.data + CURBUFINDEX);
-	memmove(be.buffers.data + CURBUFINDEX,
-			be.buffers.data + CURBUFINDEX + 1,
-			be.buffers.len-- - (size_t)(CURBUFINDEX + 1));
+	size_t n = be.windows.len, i = (size_t)be.focusedwin, k;
+	for (k = COUNT(iarg) % n; k; --k)
+		i = arg->i > 0 ? (i + 1) % n : (i + n - 1) % n;
+	winFocus(i);
 }
 
 int
 main(int argc, char *argv[])
 {
-	char *filename;
 	ARGBEGIN {
 	case 'h': default: /* fallthrough */
 		usage();
@@ -996,14 +6757,7 @@ main(int argc, char *argv[])
 		break;
 	} ARGEND
 
-	filename = NULL;
-
-	if (argc > 1)
-		usage();
-	else if (argc == 1)
-		filename = argv[0];
-
-	setup(filename);
+	setup(argv, (size_t)argc);
 	edit();
 	finish();
 
@@ -1,13 +1,33 @@
 /* See COPYRIGHT file for copyright and license details */
 
-/* focus point is focused place of buffer, for example
+/* focus point is focused row of window W, for example
    if you set this to 1, focus will be on top,
-   if you set this to be.windows.data[be.focusedwin].r - 2),
+   if you set this to ((W)->r - 1),
    focus will be on bottom */
-#define FOCUSPOINT ((be.windows.data[be.focusedwin].r - 1) / 2)
+#define FOCUSPOINT(W) (((W)->r - 1) / 2)
 
 static unsigned int tabwidth    = 4;   /* Tabulation width */
 static char indentationchar     = ' '; /* Character used for indentation */
+static size_t syncback          = 500; /* Lines lexed before far jumps */
+static size_t loadthreads       = 8;   /* Threads reading files at startup */
+static size_t sortthreads       = 8;   /* Threads sorting lines */
+static int resizedelay          = 50;  /* Milliseconds without resize before relayout */
+static int journaldelay         = 1000; /* Idle milliseconds before journals are synced */
+static size_t indexmin          = 1 << 24; /* Bytes of file whose line index is cached */
+
+/* syntax highlighting */
+static const char *highlights[] = {
+	[HlNormal]  = "\033[0m",
+	[HlComment] = "\033[0;36m",
+	[HlString]  = "\033[0;32m",
+	[HlNumber]  = "\033[0;31m",
+	[HlKeyword] = "\033[0;1;33m",
+	[HlType]    = "\033[0;33m",
+	[HlPreproc] = "\033[0;35m",
+	[HlError]   = "\033[0;1;31m",
+	[HlWarning] = "\033[0;1;35m",
+};
+#include <config/syntax.h>
 
 /* language */
 #include <lang/en_US.h>
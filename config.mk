@@ -8,6 +8,7 @@ INC = -I.
 CFLAGS = ${INC} -Wall -Wextra -Wconversion -std=c99 -pedantic
 CPPFLAGS = -D_POSIX_C_SOURCE=200809L -D_XOPEN_SOURCE=700 -DVERSION=\"${VERSION}\"
 FLAGS = ${CFLAGS} ${CPPFLAGS}
+LIBS = -pthread
 
 # compiler
 CC = gcc
@@ -4,13 +4,24 @@ static Key
 /* general modes */
 normalbindings[] = {
 	/* modifier     key     function        argument */
+	/* count */
+	{ ModNone,      '1',    countprefix,    {.i = 1} },
+	{ ModNone,      '2',    countprefix,    {.i = 2} },
+	{ ModNone,      '3',    countprefix,    {.i = 3} },
+	{ ModNone,      '4',    countprefix,    {.i = 4} },
+	{ ModNone,      '5',    countprefix,    {.i = 5} },
+	{ ModNone,      '6',    countprefix,    {.i = 6} },
+	{ ModNone,      '7',    countprefix,    {.i = 7} },
+	{ ModNone,      '8',    countprefix,    {.i = 8} },
+	{ ModNone,      '9',    countprefix,    {.i = 9} },
+
 	/* movement */
 	{ ModNone,      'h',    cursormove,     {.i = 0} },
 	{ ModNone,      'j',    cursormove,     {.i = 1} },
 	{ ModNone,      'k',    cursormove,     {.i = 2} },
 	{ ModNone,      'l',    cursormove,     {.i = 3} },
 
-	{ ModNone,      '0',    beginning,      {0} },
+	{ ModNone,      '0',    countprefix,    {.i = 0} }, /* beginning without count */
 	{ ModNone,      '$',    ending,         {0} },
 	{ ModShift,     'g',    ending,         {1} }, /* alternate g$ for vim powerusers */
 
@@ -32,12 +43,22 @@ normalbindings[] = {
 	{ ModNone,      'O',    openline,       {1} },
 	{ ModNone,      '\r',   openline,       {2} },
 
-	{ ModNone,      'd',    deleteline,     {0} },
+	{ ModNone,      'd',    operator,       {.i = OpDelete} },
 	{ ModShift,     'd',    deleteline,     {.i = -1} },
-	{ ModNone,      'c',    changeline,     {0} },
+	{ ModNone,      'c',    operator,       {.i = OpChange} },
 	{ ModShift,     'c',    changeline,     {.i = -1} },
+	{ ModNone,      'y',    operator,       {.i = OpYank} },
+	{ ModNone,      'p',    put,            {.i = 0} },
+	{ ModShift,     'p',    put,            {.i = 1} },
+	{ ModNone,      '"',    regselect,      {0} },
+
+	{ ModNone,      'q',    macrorecord,    {0} },
+	{ ModNone,      '@',    macroplay,      {0} },
 
 	{ ModNone,      'm',    togglemark,     {0} },
+	{ ModNone,      ']',    markjump,       {.i = +1} },
+	{ ModNone,      '[',    markjump,       {.i = -1} },
+	{ ModControl,   ']',    tagjump,        {0} },
 
 	/* other modes */
 	{ ModNone,      'g',    globalsubmode,  {0} },
@@ -45,6 +66,7 @@ normalbindings[] = {
 
 	/* other */
 	{ ModShift,     'z',    buffermode,     {0} },
+	{ ModControl,   'w',    winnext,        {.i = +1} },
 	{ ModNone,      0,      echoe,          {.v = "Key is not bound"} },
 },
 
@@ -53,6 +75,8 @@ editbindings[] = {
 	{ ModNone,      033,    normalmode,     {0} },
 	{ ModNone,      '\r',   normalmode,     {1} },
 	{ ModNone,      127,    removechar,     {0} },
+	{ ModControl,   'n',    complete,       {.i = +1} },
+	{ ModControl,   'p',    complete,       {.i = -1} },
 	{ ModNone,      0,      insertchar,     {0} },
 },
 
@@ -70,6 +94,12 @@ bufferbindings[] = {
 	{ ModShift,     'w',    bufwrite,       {0} },
 	{ ModShift,     'c',    bufclose,       {0} },
 	{ ModShift,     'q',    bufkill,        {0} },
+	{ ModNone,      'n',    bufswitch,      {.i = +1} },
+	{ ModNone,      'p',    bufswitch,      {.i = -1} },
+	{ ModNone,      's',    winsplit,       {.i = SplitRows} },
+	{ ModNone,      'v',    winsplit,       {.i = SplitColumns} },
+	{ ModNone,      'x',    winclose,       {0} },
+	{ ModNone,      'w',    winnext,        {.i = +1} },
 	{ ModNone,      0,      echoe,          {.v = "Key is not bound"} },
 },
 
@@ -89,6 +119,31 @@ s_globalbindings[] = {
 
 	{ ModNone,      'g',    beginning,      {1} }, /* alternate g0 for vim powerusers */
 
+	{ ModNone,      0,      echoe,          {.v = "Key is not bound"} },
+},
+
+s_operatorbindings[] = {
+	/* modifier     key     function        argument */
+	{ ModNone,      'd',    oplinewise,     {0} },
+	{ ModNone,      'c',    oplinewise,     {0} },
+	{ ModNone,      'y',    oplinewise,     {0} },
+
+	{ ModNone,      'h',    cursormove,     {.i = 0} },
+	{ ModNone,      'j',    cursormove,     {.i = 1} },
+	{ ModNone,      'k',    cursormove,     {.i = 2} },
+	{ ModNone,      'l',    cursormove,     {.i = 3} },
+
+	{ ModNone,      '0',    beginning,      {0} },
+	{ ModNone,      '$',    ending,         {0} },
+	{ ModShift,     'g',    ending,         {1} },
+
+	{ ModNone,      'f',    findchar,       {0} },
+	{ ModShift,     'f',    findchar,       {1} },
+	{ ModNone,      't',    findchar,       {2} },
+	{ ModShift,     't',    findchar,       {3} },
+
+	{ ModNone,      'g',    globalsubmode,  {0} },
+
 	{ ModNone,      0,      echoe,          {.v = "Key is not bound"} },
 };
 
@@ -103,4 +158,5 @@ static Binding bindings[] = {
 	[ModeCommand]       = BIND(commandbindings),
 
 	[SubModeGlobal]     = BIND(s_globalbindings),
+	[SubModeOperator]   = BIND(s_operatorbindings),
 };
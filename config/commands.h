@@ -7,5 +7,23 @@ commands[] = {
 	{ "write",              "w",        bufwrite,       {0} },
 	{ "close",              "c",        bufclose,       {0} },
 	{ "quit",               "q",        bufkill,        {0} },
+	{ "buffers",            "ls",       buflist,        {0} },
+	{ "buffer",             "b",        bufswitch,      {0} },
+	{ "bnext",              "bn",       bufswitch,      {.i = +1} },
+	{ "bprevious",          "bp",       bufswitch,      {.i = -1} },
+	{ "split",              "sp",       winsplit,       {.i = SplitRows} },
+	{ "vsplit",             "vs",       winsplit,       {.i = SplitColumns} },
+	{ "wclose",             "wc",       winclose,       {0} },
+	{ "wnext",              "wn",       winnext,        {.i = +1} },
+	{ "delete",             "d",        delete,         {0} },
+	{ "yank",               "y",        yank,           {0} },
+	{ "put",                "pu",       cmdput,         {0} },
+	{ "substitute",         "s",        substitute,     {0} },
 	{ "shell",              "sh",       shell,          {0} },
+	{ "!",                  NULL,       filter,         {0} },
+	{ "sort",               "sor",      sort,           {0} },
+	{ "follow",             "fo",       follow,         {0} },
+	{ "goto",               "go",       gotobyte,       {0} },
+	{ "tag",                "ta",       tag,            {0} },
+	{ "tags",               NULL,       tagindex,       {0} },
 };
@@ -0,0 +1,63 @@
+/* See COPYRIGHT file for copyright and license details */
+
+static const SynWord cwords[] = {
+	{ "break",    HlKeyword }, { "case",     HlKeyword },
+	{ "continue", HlKeyword }, { "default",  HlKeyword },
+	{ "do",       HlKeyword }, { "else",     HlKeyword },
+	{ "for",      HlKeyword }, { "goto",     HlKeyword },
+	{ "if",       HlKeyword }, { "return",   HlKeyword },
+	{ "sizeof",   HlKeyword }, { "switch",   HlKeyword },
+	{ "while",    HlKeyword }, { "typedef",  HlKeyword },
+	{ "NULL",     HlNumber  },
+	{ "auto",     HlType    }, { "char",     HlType    },
+	{ "const",    HlType    }, { "double",   HlType    },
+	{ "enum",     HlType    }, { "extern",   HlType    },
+	{ "float",    HlType    }, { "inline",   HlType    },
+	{ "int",      HlType    }, { "long",     HlType    },
+	{ "register", HlType    }, { "restrict", HlType    },
+	{ "short",    HlType    }, { "signed",   HlType    },
+	{ "static",   HlType    }, { "struct",   HlType    },
+	{ "union",    HlType    }, { "unsigned", HlType    },
+	{ "void",     HlType    }, { "volatile", HlType    },
+	{ "size_t",   HlType    }, { "ssize_t",  HlType    },
+	{ NULL },
+};
+
+static const SynWord shwords[] = {
+	{ "case",     HlKeyword }, { "do",       HlKeyword },
+	{ "done",     HlKeyword }, { "elif",     HlKeyword },
+	{ "else",     HlKeyword }, { "esac",     HlKeyword },
+	{ "exit",     HlKeyword }, { "fi",       HlKeyword },
+	{ "for",      HlKeyword }, { "if",       HlKeyword },
+	{ "in",       HlKeyword }, { "return",   HlKeyword },
+	{ "then",     HlKeyword }, { "until",    HlKeyword },
+	{ "while",    HlKeyword },
+	{ "export",   HlType    }, { "local",    HlType    },
+	{ "readonly", HlType    }, { "set",      HlType    },
+	{ "unset",    HlType    },
+	{ NULL },
+};
+
+static const SynWord logwords[] = {
+	{ "FATAL",    HlError   }, { "ERROR",    HlError   },
+	{ "error",    HlError   }, { "WARN",     HlWarning },
+	{ "WARNING",  HlWarning }, { "warning",  HlWarning },
+	{ "INFO",     HlKeyword }, { "NOTICE",   HlKeyword },
+	{ "DEBUG",    HlComment }, { "TRACE",    HlComment },
+	{ NULL },
+};
+
+/* first matching one is used, see Syntax in be.c */
+static const Syntax syntaxes[] = {
+	/* name     match
+	   comment  open   close  quotes  directive  variable  multiline  words */
+	{ "c",      ".c .h .cc .cpp .hh .hpp",
+	  "//",     "/*",  "*/",  "\"'",  '#',       0,        0,         cwords },
+	{ "shell",  ".sh .bash .zsh .profile .bashrc #!/bin/sh #!/bin/bash "
+	            "#!/usr/bin/env sh #!/usr/bin/env bash",
+	  "#",      NULL,  NULL,  "\"'`", 0,         '$',      1,         shwords },
+	{ "config", ".conf .cfg .ini .toml .mk Makefile .gitconfig",
+	  "#",      NULL,  NULL,  "\"'",  '[',       '$',      0,         NULL },
+	{ "log",    ".log",
+	  NULL,     NULL,  NULL,  "\"",   0,         0,        0,         logwords },
+};
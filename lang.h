@@ -7,13 +7,22 @@ typedef enum {
 
 typedef enum {
 	InfoAlreadyBeg, InfoAlreadyBot, InfoAlreadyTop, InfoAlreadyEnd,
-	InfoPressAnyKey,
+	InfoPressAnyKey, InfoNoMarks,
+	InfoJobDone, InfoFollowOn, InfoFollowOff, InfoTruncated, InfoReopened,
+	InfoReloaded, InfoReloadAsk, InfoRecovered,
+	InfoComplete, InfoCompleteBack, InfoNoCompletion,
+	InfoTagsScan, InfoTagsDone,
 } Info;
 
 typedef enum {
 	ErrUsage = 0, ErrScreenTooSmall,
 	ErrDirty, ErrWriteAnon,
-	ErrCmdNotFound,
+	ErrCmdNotFound, ErrRange, ErrArgs,
+	ErrPattern, ErrNoMatch, ErrRegEmpty,
+	ErrMacroName, ErrNoBuffer,
+	ErrWinSmall, ErrLastWin, ErrFollow, ErrChanged,
+	ErrJnlBusy, ErrJnlStale, ErrJnlWrite, ErrOffset,
+	ErrNoTag, ErrTagsBusy, ErrLoading, ErrIndexStale,
 } Errno;
 
 #endif
@@ -11,6 +11,7 @@ static char
 	[ModeBuffer]        = "Buffer",
 	[ModeCommand]       = "Command",
 	[SubModeGlobal]     = "Global",
+	[SubModeOperator]   = "Operator",
 },
 *lang_info[] = {
 	[InfoAlreadyBeg]    = "Already on beginning of line",
@@ -18,6 +19,20 @@ static char
 	[InfoAlreadyTop]    = "Already on top",
 	[InfoAlreadyEnd]    = "Already on end of line",
 	[InfoPressAnyKey]   = "Press any key to continue",
+	[InfoNoMarks]       = "No more marked lines",
+	[InfoJobDone]       = "\"%s\" exited with status %d",
+	[InfoFollowOn]      = "Following file",
+	[InfoFollowOff]     = "Stopped following file",
+	[InfoTruncated]     = "File was truncated",
+	[InfoReopened]      = "File was replaced, reading new one",
+	[InfoReloaded]      = "%s changed on disk, reloaded",
+	[InfoReloadAsk]     = "%s changed on disk, reload and lose changes? (y/n)",
+	[InfoRecovered]     = "%s: %lu changes recovered from journal",
+	[InfoComplete]      = "Word %lu of %lu",
+	[InfoCompleteBack]  = "Back at typed word",
+	[InfoNoCompletion]  = "No words to complete",
+	[InfoTagsScan]      = "Scanning %s for tags",
+	[InfoTagsDone]      = "%lu tags found in %s",
 },
 *lang_err[] = {
 	[ErrUsage]          = "usage",
@@ -25,4 +40,23 @@ static char
 	[ErrDirty]          = "buffer have unsaved changes",
 	[ErrWriteAnon]      = "cannot write anonymous buffer without filename",
 	[ErrCmdNotFound]    = "command not found",
+	[ErrRange]          = "invalid range",
+	[ErrArgs]           = "invalid arguments",
+	[ErrPattern]        = "invalid pattern",
+	[ErrNoMatch]        = "pattern not found",
+	[ErrRegEmpty]       = "register is empty",
+	[ErrMacroName]      = "invalid macro name",
+	[ErrNoBuffer]       = "no such buffer",
+	[ErrWinSmall]       = "window is too small to split",
+	[ErrLastWin]        = "cannot close last window",
+	[ErrFollow]         = "buffer has no file to follow",
+	[ErrChanged]        = "file changed on disk, use :w! to overwrite",
+	[ErrJnlBusy]        = "%s is being edited by process %ld",
+	[ErrJnlStale]       = "%s changed since its journal was written, journal moved to %s",
+	[ErrJnlWrite]       = "%s: journal cannot be written (%s), changes are not journaled",
+	[ErrOffset]         = "offset beyond end of buffer",
+	[ErrNoTag]          = "tag not found",
+	[ErrTagsBusy]       = "directory is being scanned already",
+	[ErrLoading]        = "buffer is still being read",
+	[ErrIndexStale]     = "%s: its line index was wrong, file is read again",
 };
@@ -26,6 +26,15 @@ Strcmpc(String s1, char *s2)
 	return strncmp(s1.data, s2, s1.len);
 }
 
+int
+Strorder(String a, String b)
+{
+	int r;
+	if ((r = memcmp(a.data, b.data, a.len < b.len ? a.len : b.len)))
+		return r;
+	return (a.len > b.len) - (a.len < b.len);
+}
+
 ssize_t
 Strtok(String string, String *out, char c)
 {
@@ -66,14 +75,54 @@ Strtok2(String *i, String *o, char c)
 	return n;
 }
 
+ssize_t
+Strarg(String *i, String *o)
+{
+	char *r, *w, *end, q;
+
+	while (i->len && isspace((unsigned char)*(i->data))) {
+		++(i->data);
+		--(i->len);
+	}
+	o->data = i->data;
+	o->len = 0;
+	if (!i->len) return 0;
+
+	r = w = i->data;
+	end = i->data + i->len;
+	for (q = 0; r < end; ) {
+		if (q) {
+			if (*r == q) {
+				q = 0; ++r;
+				continue;
+			}
+			if (q == '"' && *r == '\\' && r + 1 < end) ++r;
+		} else if (isspace((unsigned char)*r)) {
+			break;
+		} else if (*r == '\'' || *r == '"') {
+			q = *r++;
+			continue;
+		} else if (*r == '\\' && r + 1 < end) {
+			++r;
+		}
+		*w++ = *r++;
+	}
+	if (q) return -1;
+
+	o->len = (size_t)(w - o->data);
+	i->len -= (size_t)(r - i->data);
+	i->data = r;
+	return r - o->data;
+}
+
 String
 Striden(String str)
 {
 	size_t i;
-	for (i = 0; ((str.data[i] >= 'a' && str.data[i] <= 'z')
+	for (i = 0; (i < str.len)
+				&& ((str.data[i] >= 'a' && str.data[i] <= 'z')
 				|| (str.data[i] >= 'A' && str.data[i] <= 'Z')
-				|| (str.data[i] && str.data[i] >= '0' && str.data[i] <= '9'))
-				&& (i < str.len); ++i);
+				|| (str.data[i] && str.data[i] >= '0' && str.data[i] <= '9')); ++i);
 	str.len = i;
 	return str;
 }
@@ -19,8 +19,10 @@ typedef struct {
 String toString(char *s);
 int Strcmp(String a, String b);
 int Strcmpc(String s1, char *s2);
+int Strorder(String a, String b);
 ssize_t Strtok(String string, String *out, char c);
 ssize_t Strtok2(String *i, String *o, char c);
+ssize_t Strarg(String *i, String *o);
 String Striden(String string);
 String Strtrim(String str);
 